@@ -34,12 +34,18 @@
 #include "DataEncoders/FlipNWrite/FlipNWrite.h"
 
 #include <iostream>
+#include <string.h>
 
 using namespace NVM;
 
 FlipNWrite::FlipNWrite( )
 {
-    flippedAddresses.clear( );
+    flippedRows.clear( );
+
+    fpSize = 32;
+    wordSize = 0;
+    flipPartitions = 0;
+    rowPartitions = 0;
 
     /* Clear statistics */
     bitsFlipped = 0;
@@ -61,11 +67,23 @@ void FlipNWrite::SetConfig( Config *config, bool /*createChildren*/ )
     SetParams( params );
 
     /* Cache granularity size. */
-    fpSize = config->GetValue( "FlipNWriteGranularity" );
+    int granularity = config->GetValue( "FlipNWriteGranularity" );
 
     /* Some default size if the parameter is not specified */
-    if( fpSize == -1 )
-        fpSize = 32; 
+    if( granularity <= 0 )
+        granularity = 32; 
+
+    fpSize = static_cast<uint64_t>( granularity );
+
+    wordSize = p->BusWidth;
+    wordSize *= p->tBURST * p->RATE;
+    wordSize /= 8;
+
+    rowPartitions = ( p->COLS * wordSize * 8 ) / fpSize;
+    flipPartitions = ( wordSize * 8 ) / fpSize; 
+
+    oldWords.assign( (wordSize + 7) / 8, 0 );
+    newWords.assign( (wordSize + 7) / 8, 0 );
 }
 
 void FlipNWrite::RegisterStats( )
@@ -75,44 +93,64 @@ void FlipNWrite::RegisterStats( )
     AddUnitStat(flipNWriteReduction, "%");
 }
 
-void FlipNWrite::InvertData( NVMDataBlock& data, uint64_t startBit, uint64_t endBit )
+/*
+ *  Bit n of a line is bit n%8 of byte n/8, so loading the bytes little
+ *  endian puts bit n at bit n%64 of word n/64.
+ */
+void FlipNWrite::LoadWords( NVMDataBlock& data, std::vector<uint64_t>& words )
 {
-    uint64_t wordSize;
-    int startByte, endByte;
+    uint64_t bytes = ( data.GetSize( ) < wordSize ) ? data.GetSize( ) : wordSize;
 
-    wordSize = p->BusWidth;
-    wordSize *= p->tBURST * p->RATE;
-    wordSize /= 8;
+    for( uint64_t i = 0; i < words.size( ); i++ )
+        words[i] = 0;
 
-    startByte = (int)(startBit / 8);
-    endByte = (int)((endBit - 1) / 8);
+    if( !data.IsValid( ) || data.rawData == NULL )
+        return;
 
-    for( int i = startByte; i <= endByte; i++ )
-    {
-        uint8_t originalByte = data.GetByte( i );
-        uint8_t shiftByte = originalByte;
-        uint8_t newByte = 0;
+    for( uint64_t i = 0; i < bytes; i++ )
+        words[i / 8] |= static_cast<uint64_t>( data.rawData[i] ) << ( 8 * (i % 8) );
+}
 
-        for( int j = 0; j < 8; j++ )
-        {
-            uint64_t currentBit = i * 8 + j;
-           
-            if( currentBit < startBit || currentBit >= endBit )
-            {
-                shiftByte = static_cast<uint8_t>(shiftByte >> 1);
-                continue;
-            }
+void FlipNWrite::StoreWords( NVMDataBlock& data, std::vector<uint64_t>& words )
+{
+    uint64_t bytes = ( data.GetSize( ) < wordSize ) ? data.GetSize( ) : wordSize;
 
-            if( !(shiftByte & 0x1) )
-            {
-                newByte = static_cast<uint8_t>(newByte | (1 << (7-j)));
-            }
+    if( !data.IsValid( ) || data.rawData == NULL )
+        return;
 
-            shiftByte = static_cast<uint8_t>(shiftByte >> 1);
-        }
+    for( uint64_t i = 0; i < bytes; i++ )
+        data.rawData[i] = static_cast<uint8_t>( words[i / 8] >> ( 8 * (i % 8) ) );
+}
+
+/* Bits of 64-bit word number 'word' that fall in [startBit, endBit). */
+uint64_t FlipNWrite::PartitionMask( uint64_t word, uint64_t startBit, uint64_t endBit )
+{
+    uint64_t first = word * 64;
+    uint64_t lo = ( startBit > first ) ? startBit - first : 0;
+    uint64_t hi = ( endBit < first + 64 ) ? endBit - first : 64;
+    uint64_t mask = ( hi == 64 ) ? ~0ULL : ( (1ULL << hi) - 1 );
 
-        data.SetByte( i, newByte );
+    return mask & ~( (1ULL << lo) - 1 );
+}
+
+/* Number of bits that differ between the old and new line in [startBit, endBit). */
+uint64_t FlipNWrite::CountBits( uint64_t startBit, uint64_t endBit )
+{
+    uint64_t count = 0;
+
+    for( uint64_t w = startBit / 64; w * 64 < endBit; w++ )
+    {
+        count += __builtin_popcountll( ( oldWords[w] ^ newWords[w] ) 
+                                       & PartitionMask( w, startBit, endBit ) );
     }
+
+    return count;
+}
+
+void FlipNWrite::InvertData( std::vector<uint64_t>& words, uint64_t startBit, uint64_t endBit )
+{
+    for( uint64_t w = startBit / 64; w * 64 < endBit; w++ )
+        words[w] ^= PartitionMask( w, startBit, endBit );
 }
 
 ncycle_t FlipNWrite::Read( NVMainRequest* /*request*/ )
@@ -128,141 +166,81 @@ ncycle_t FlipNWrite::Write( NVMainRequest *request )
 {
     NVMDataBlock& newData = request->data;
     NVMDataBlock& oldData = request->oldData;
-    NVMAddress address = request->address;
 
-    /*
-     *  The default life map is an stl map< uint64_t, uint64_t >. 
-     *  You may map row and col to this map_key however you want.
-     *  It is up to you to ensure there are no collisions here.
-     */
     uint64_t row;
     uint64_t col;
     ncycle_t rv = 0;
+    bool oldInverted = false;
+    bool newInverted = false;
 
     request->address.GetTranslatedAddress( &row, &col, NULL, NULL, NULL, NULL );
 
-    /*
-     *  If using the default life map, we can call the DecrementLife
-     *  function which will check if the map_key already exists. If so,
-     *  the life value is decremented (write count incremented). Otherwise 
-     *  the map_key is inserted with a write count of 1.
-     */
-    uint64_t rowSize;
-    uint64_t wordSize;
-    uint64_t currentBit;
-    uint64_t flipPartitions;
-    uint64_t rowPartitions;
-    int *modifyCount;
-
-    wordSize = p->BusWidth;
-    wordSize *= p->tBURST * p->RATE;
-    wordSize /= 8;
-
-    rowSize = p->COLS * wordSize;
-    rowPartitions = ( rowSize * 8 ) / fpSize;
-    
-    flipPartitions = ( wordSize * 8 ) / fpSize; 
+    LoadWords( oldData, oldWords );
+    LoadWords( newData, newWords );
 
-    modifyCount = new int[ flipPartitions ];
+    std::unordered_map<uint64_t, std::vector<uint64_t> >::iterator it = flippedRows.find( row );
+    std::vector<uint64_t> *flipBits = ( it != flippedRows.end( ) ) ? &(it->second) : NULL;
 
     /*
-     *  Count the number of bits that are modified. If it is more than
-     *  half, then we will invert the data then write.
+     *  Count the number of bits that are modified in each partition. If it
+     *  is more than half, then we will invert the data then write. What is
+     *  currently in memory may itself be inverted, so previously flipped
+     *  partitions of the old data are inverted first.
      */
-    for( uint64_t i = 0; i < flipPartitions; i++ )
-        modifyCount[i] = 0;
-
-    currentBit = 0;
-
-    /* Get what is currently in the memory (i.e., if it was previously flipped, get the flipped data. */
     for( uint64_t i = 0; i < flipPartitions; i++ )
     {
-        uint64_t curAddr = row * rowPartitions + col * flipPartitions + i;
+        uint64_t curBit = col * flipPartitions + i;
+        uint64_t startBit = i * fpSize;
+        uint64_t endBit = (i + 1) * fpSize;
+        bool flipped = ( flipBits != NULL ) 
+                       && ( ((*flipBits)[curBit / 64] >> (curBit % 64)) & 0x1 );
 
-        if( flippedAddresses.count( curAddr ) )
+        if( flipped )
         {
-            InvertData( oldData, i*fpSize, (i+1)*fpSize );
+            InvertData( oldWords, startBit, endBit );
+            oldInverted = true;
         }
-    }
-
-    /* Check each byte to see if it was modified */
-    for( uint64_t i = 0; i < wordSize; ++i )
-    {
-        /*
-         *  If no bytes have changed we can just continue. Yes, I know this
-         *  will check the byte 8 times, but i'd rather not change the iter.
-         */
-        uint8_t oldByte, newByte;
-
-        oldByte = oldData.GetByte( i );
-        newByte = newData.GetByte( i );
-
-        if( oldByte == newByte )
-        {
-            currentBit += 8;
-            continue;
-        }
-
-        /*
-         *  If the bytes are different, then at least one bit has changed.
-         *  check each bit individually.
-         */
-        for( int j = 0; j < 8; j++ )
-        {
-            uint8_t oldBit, newBit;
-
-            oldBit = ( oldByte >> j ) & 0x1;
-            newBit = ( newByte >> j ) & 0x1;
-
-            if( oldBit != newBit )
-            {
-                modifyCount[(int)(currentBit/fpSize)]++;
-            }
-
-            currentBit++;
-        }
-    }
 
-    /*
-     *  Flip any partitions as needed and mark them as inverted or not.
-     */
-    for( uint64_t i = 0; i < flipPartitions; i++ )
-    {
-        bitCompareSwapWrites += modifyCount[i];
+        uint64_t modifyCount = CountBits( startBit, endBit );
 
-        uint64_t curAddr = row * rowPartitions + col * flipPartitions + i;
+        bitCompareSwapWrites += modifyCount;
 
         /* Invert if more than half of the bits are modified. */
-        if( modifyCount[i] > (fpSize / 2) )
+        if( modifyCount > (fpSize / 2) )
         {
-            InvertData( newData, i*fpSize, (i+1)*fpSize );
+            InvertData( newWords, startBit, endBit );
+            newInverted = true;
 
-            bitsFlipped += (fpSize - modifyCount[i]);
+            bitsFlipped += (fpSize - modifyCount);
 
             /*
-             *  Mark this address as flipped. If the data was already inverted, it
+             *  Mark this partition as flipped. If the data was already inverted, it
              *  should remain as inverted for the new data.
              */
-            if( !flippedAddresses.count( curAddr ) )
+            if( flipBits == NULL )
             {
-                flippedAddresses.insert( curAddr );
+                flipBits = &flippedRows[row];
+                flipBits->assign( (rowPartitions + 63) / 64, 0 );
             }
+
+            (*flipBits)[curBit / 64] |= (1ULL << (curBit % 64));
         }
         else
         {
             /*
              *  This data is not inverted and should not be marked as such.
              */
-            if( flippedAddresses.count( curAddr ) )
-            {
-                flippedAddresses.erase( curAddr );
-            }
+            if( flipped )
+                (*flipBits)[curBit / 64] &= ~(1ULL << (curBit % 64));
 
-            bitsFlipped += modifyCount[i];
+            bitsFlipped += modifyCount;
         }
     }
 
-    delete modifyCount;
+    if( oldInverted )
+        StoreWords( oldData, oldWords );
+    if( newInverted )
+        StoreWords( newData, newWords );
     
     return rv;
 }
@@ -274,3 +252,40 @@ void FlipNWrite::CalculateStats( )
     else
         flipNWriteReduction = 100.0;
 }
+
+void FlipNWrite::SaveCheckpoint( std::ostream& out )
+{
+    CheckpointWrite( out, fpSize );
+    CheckpointWrite( out, wordSize );
+    CheckpointWrite( out, rowPartitions );
+    CheckpointWrite( out, flippedRows );
+}
+
+bool FlipNWrite::RestoreCheckpoint( std::istream& in )
+{
+    uint64_t savedSize, savedWordSize, savedPartitions;
+    std::unordered_map<uint64_t, std::vector<uint64_t> > savedRows;
+    std::unordered_map<uint64_t, std::vector<uint64_t> >::iterator it;
+
+    if( !CheckpointRead( in, savedSize ) || !CheckpointRead( in, savedWordSize )
+        || !CheckpointRead( in, savedPartitions ) )
+        return false;
+
+    /* Flip bits only line up with the same granularity and row geometry. */
+    if( savedSize != fpSize || savedWordSize != wordSize 
+        || savedPartitions != rowPartitions )
+        return false;
+
+    if( !CheckpointRead( in, savedRows ) )
+        return false;
+
+    for( it = savedRows.begin( ); it != savedRows.end( ); it++ )
+    {
+        if( it->second.size( ) != (rowPartitions + 63) / 64 )
+            return false;
+    }
+
+    flippedRows.swap( savedRows );
+
+    return true;
+}
@@ -0,0 +1,92 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+* 
+* Author list: 
+*   Matt Poremba    ( Email: mrp5060 at psu dot edu 
+*                     Website: http://www.cse.psu.edu/~poremba/ )
+*******************************************************************************/
+
+#ifndef __NVMAIN_FLIPNWRITE_H__
+#define __NVMAIN_FLIPNWRITE_H__
+
+#include "src/DataEncoder.h"
+#include "src/Checkpoint.h"
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace NVM {
+
+class FlipNWrite : public DataEncoder, public Checkpointable
+{
+  public:
+    FlipNWrite( );
+    ~FlipNWrite( );
+
+    void SetConfig( Config *config, bool createChildren = true );
+
+    ncycle_t Read( NVMainRequest *request );
+    ncycle_t Write( NVMainRequest *request );
+
+    void RegisterStats( );
+    void CalculateStats( );
+
+    void SaveCheckpoint( std::ostream& out );
+    bool RestoreCheckpoint( std::istream& in );
+
+  private:
+    /*
+     *  One flip bit per partition of a row, packed 64 to a word. Rows are
+     *  only allocated once one of their partitions has been flipped.
+     */
+    std::unordered_map<uint64_t, std::vector<uint64_t> > flippedRows;
+    uint64_t fpSize;
+    uint64_t wordSize;
+    uint64_t flipPartitions;
+    uint64_t rowPartitions;
+
+    /* Scratch copies of the old and new line, 64 bits at a time. */
+    std::vector<uint64_t> oldWords;
+    std::vector<uint64_t> newWords;
+
+    /* Stats */
+    uint64_t bitsFlipped;
+    uint64_t bitCompareSwapWrites;
+    double flipNWriteReduction;
+
+    void LoadWords( NVMDataBlock& data, std::vector<uint64_t>& words );
+    void StoreWords( NVMDataBlock& data, std::vector<uint64_t>& words );
+    uint64_t CountBits( uint64_t startBit, uint64_t endBit );
+    void InvertData( std::vector<uint64_t>& words, uint64_t startBit, uint64_t endBit );
+    uint64_t PartitionMask( uint64_t word, uint64_t startBit, uint64_t endBit );
+};
+
+};
+
+#endif
@@ -0,0 +1,316 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "DataEncoders/TLCRemap/TLCRemap.h"
+#include "include/NVMHelpers.h"
+
+#include <iostream>
+
+using namespace NVM;
+
+TLCRemap::TLCRemap( )
+{
+    rowTags.clear( );
+
+    wordSize = 0;
+    wordsPerLine = 0;
+    mappings = 4;
+
+    /*
+     *  Identity, all three bits complemented, the middle bit (bit 1)
+     *  complemented, and the outer bits (bits 0 and 2) complemented.
+     */
+    masks[0] = 0x0;
+    masks[1] = 0x7;
+    masks[2] = 0x2;
+    masks[3] = 0x5;
+
+    /* Clear statistics */
+    remapWrites = 0;
+    remappedWords = 0;
+    baselinePulses = 0;
+    remapPulses = 0;
+    baselineEnergy = 0.0;
+    remapEnergy = 0.0;
+    remapLatencyReduction = 0.0;
+    remapEnergyReduction = 0.0;
+}
+
+TLCRemap::~TLCRemap( )
+{
+    /*
+     *  Nothing to do here. We do not own the *config pointer, so
+     *  don't delete that.
+     */
+}
+
+void TLCRemap::SetConfig( Config *config, bool /*createChildren*/ )
+{
+    Params *params = new Params( );
+    params->SetParams( config );
+    SetParams( params );
+
+    /* One or two tag bits per word select among two or four mappings. */
+    int tagBits = 2;
+
+    if( config->KeyExists( "TLCRemapTagBits" ) )
+        tagBits = config->GetValue( "TLCRemapTagBits" );
+
+    mappings = ( tagBits <= 1 ) ? 2 : 4;
+
+    wordSize = p->BusWidth;
+    wordSize *= p->tBURST * p->RATE;
+    wordSize /= 8;
+
+    wordsPerLine = wordSize / 4;
+
+    nWPTLC[0] = p->nWP000;
+    nWPTLC[1] = p->nWP001;
+    nWPTLC[2] = p->nWP010;
+    nWPTLC[3] = p->nWP011;
+    nWPTLC[4] = p->nWP100;
+    nWPTLC[5] = p->nWP101;
+    nWPTLC[6] = p->nWP110;
+    nWPTLC[7] = p->nWP111;
+
+    EwrTLC[0] = p->Ewr000;
+    EwrTLC[1] = p->Ewr001;
+    EwrTLC[2] = p->Ewr010;
+    EwrTLC[3] = p->Ewr011;
+    EwrTLC[4] = p->Ewr100;
+    EwrTLC[5] = p->Ewr101;
+    EwrTLC[6] = p->Ewr110;
+    EwrTLC[7] = p->Ewr111;
+}
+
+void TLCRemap::RegisterStats( )
+{
+    AddStat(remapWrites);
+    AddStat(remappedWords);
+    AddStat(baselinePulses);
+    AddStat(remapPulses);
+    AddUnitStat(remapLatencyReduction, "%");
+    AddUnitStat(remapEnergyReduction, "%");
+}
+
+/*
+ *  XOR every cell with the mapping's mask. The top cell only has two bits,
+ *  so it gets the low two bits of the mask. XOR mappings are their own
+ *  inverse, so reads decode with the same operation.
+ */
+uint32_t TLCRemap::Remap( uint32_t word, uint64_t mapping )
+{
+    uint32_t mask = masks[mapping];
+    uint32_t wordMask = 0;
+
+    for( int cell = 0; cell < 11; cell++ )
+        wordMask |= mask << (3 * cell);
+
+    return word ^ wordMask;
+}
+
+/*
+ *  Cost of writing a word the way SubArray::WriteCellData2 times it: the
+ *  slowest state among the changed cells, and the energy of every change.
+ *  Only the top cells of the word are programmed, all 11 for a full word.
+ */
+void TLCRemap::WordCost( uint32_t word, uint32_t oldWord, uint64_t cells,
+                         ncycle_t& pulses, double& energy )
+{
+    pulses = 0;
+    energy = 0.0;
+
+    word = word >> (3 * (11 - cells));
+    oldWord = oldWord >> (3 * (11 - cells));
+
+    for( uint64_t cell = 0; cell < cells; cell++ )
+    {
+        uint32_t state = word & 0x7;
+
+        if( state != (oldWord & 0x7) )
+        {
+            pulses = MAX( pulses, nWPTLC[state] );
+            energy += EwrTLC[state];
+        }
+
+        word = word >> 3;
+        oldWord = oldWord >> 3;
+    }
+}
+
+/*
+ *  The per-word tag bits are stored with the words and are sensed with
+ *  the line itself, so a read costs nothing beyond the array read.
+ */
+ncycle_t TLCRemap::Read( NVMainRequest* /*request*/ )
+{
+    ncycle_t rv = 0;
+
+    return rv;
+}
+
+ncycle_t TLCRemap::Write( NVMainRequest *request ) 
+{
+    NVMDataBlock& newData = request->data;
+    NVMDataBlock& oldData = request->oldData;
+    uint32_t *newWords;
+    uint32_t *oldWords;
+    uint64_t row, col, words, tailBits = 0;
+    ncycle_t rv = 0;
+
+    /* Remap whatever SubArray will program: the compressed payload if any. */
+    if( newData.IsCompressed( ) )
+    {
+        newWords = reinterpret_cast<uint32_t*>( newData.comData );
+        words = ( newData.GetComSize( ) + 3 ) / 4;
+        tailBits = ( newData.GetComSize( ) * 8 ) % 32;
+    }
+    else
+    {
+        newWords = reinterpret_cast<uint32_t*>( newData.rawData );
+        words = wordsPerLine;
+    }
+
+    if( oldData.IsCompressed( ) )
+        oldWords = reinterpret_cast<uint32_t*>( oldData.comData );
+    else
+        oldWords = reinterpret_cast<uint32_t*>( oldData.rawData );
+
+    if( newWords == NULL || oldWords == NULL )
+        return rv;
+
+    if( words > wordsPerLine )
+    {
+        words = wordsPerLine;
+        tailBits = 0;
+    }
+
+    request->address.GetTranslatedAddress( &row, &col, NULL, NULL, NULL, NULL );
+
+    std::vector<uint8_t>& tags = rowTags[row];
+
+    if( tags.empty( ) )
+        tags.assign( p->COLS * wordsPerLine, 0 );
+
+    remapWrites++;
+
+    for( uint64_t i = 0; i < words; i++ )
+    {
+        uint8_t& tag = tags[col * wordsPerLine + i];
+        uint32_t stored = Remap( oldWords[i], tag );
+        uint64_t best = 0;
+        ncycle_t bestPulses, pulses;
+        double bestEnergy, energy;
+        uint64_t cells = 11;
+
+        /* SubArray only programs the top ceil(tailBits / 3) cells of a partial last word. */
+        if( i == words - 1 && tailBits != 0 )
+            cells = tailBits / 3 + ((tailBits % 3) ? 1 : 0);
+
+        /* Without the encoder the plain data would overwrite the plain old data. */
+        WordCost( newWords[i], oldWords[i], cells, pulses, energy );
+        baselinePulses += pulses;
+        baselineEnergy += energy;
+
+        WordCost( Remap( newWords[i], 0 ), stored, cells, bestPulses, bestEnergy );
+        for( uint64_t mapping = 1; mapping < mappings; mapping++ )
+        {
+            WordCost( Remap( newWords[i], mapping ), stored, cells, pulses, energy );
+
+            if( pulses < bestPulses || (pulses == bestPulses && energy < bestEnergy) )
+            {
+                best = mapping;
+                bestPulses = pulses;
+                bestEnergy = energy;
+            }
+        }
+
+        remapPulses += bestPulses;
+        remapEnergy += bestEnergy;
+        if( best != 0 )
+            remappedWords++;
+
+        /* SubArray compares the cells as they are actually stored. */
+        oldWords[i] = stored;
+        newWords[i] = Remap( newWords[i], best );
+        tag = static_cast<uint8_t>( best );
+    }
+
+    return rv;
+}
+
+void TLCRemap::CalculateStats( )
+{
+    if( baselinePulses != 0 )
+        remapLatencyReduction = (1.0 - (double)remapPulses / (double)baselinePulses) * 100.0;
+    else
+        remapLatencyReduction = 0.0;
+
+    if( baselineEnergy > 0.0 )
+        remapEnergyReduction = (1.0 - remapEnergy / baselineEnergy) * 100.0;
+    else
+        remapEnergyReduction = 0.0;
+}
+
+void TLCRemap::SaveCheckpoint( std::ostream& out )
+{
+    CheckpointWrite( out, mappings );
+    CheckpointWrite( out, p->COLS );
+    CheckpointWrite( out, wordsPerLine );
+    CheckpointWrite( out, rowTags );
+}
+
+bool TLCRemap::RestoreCheckpoint( std::istream& in )
+{
+    uint64_t savedMappings, savedWords;
+    ncounter_t savedCols;
+    std::unordered_map<uint64_t, std::vector<uint8_t> > savedTags;
+    std::unordered_map<uint64_t, std::vector<uint8_t> >::iterator it;
+
+    if( !CheckpointRead( in, savedMappings ) || !CheckpointRead( in, savedCols )
+        || !CheckpointRead( in, savedWords ) )
+        return false;
+
+    /* Tags saved with four mappings are not valid with one tag bit. */
+    if( savedMappings != mappings || savedCols != p->COLS || savedWords != wordsPerLine )
+        return false;
+
+    if( !CheckpointRead( in, savedTags ) )
+        return false;
+
+    for( it = savedTags.begin( ); it != savedTags.end( ); it++ )
+    {
+        if( it->second.size( ) != p->COLS * wordsPerLine )
+            return false;
+    }
+
+    rowTags.swap( savedTags );
+
+    return true;
+}
@@ -0,0 +1,92 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef __NVMAIN_TLCREMAP_H__
+#define __NVMAIN_TLCREMAP_H__
+
+#include "src/DataEncoder.h"
+#include "src/Checkpoint.h"
+
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace NVM {
+
+/*
+ *  TLC cell-state remapping. Every 32-bit word (ten 3-bit cells and one
+ *  2-bit cell) is stored with one of up to four XOR mappings of its cell
+ *  states, chosen to keep the slow intermediate states out of the cells a
+ *  write changes. The mapping of each word is kept in per-word tag bits.
+ */
+class TLCRemap : public DataEncoder, public Checkpointable
+{
+  public:
+    TLCRemap( );
+    ~TLCRemap( );
+
+    void SetConfig( Config *config, bool createChildren = true );
+
+    ncycle_t Read( NVMainRequest *request );
+    ncycle_t Write( NVMainRequest *request );
+
+    void RegisterStats( );
+    void CalculateStats( );
+
+    void SaveCheckpoint( std::ostream& out );
+    bool RestoreCheckpoint( std::istream& in );
+
+  private:
+    /* Mapping tag of every word of a row, allocated on the row's first write. */
+    std::unordered_map<uint64_t, std::vector<uint8_t> > rowTags;
+    uint64_t wordSize;
+    uint64_t wordsPerLine;
+    uint64_t mappings;
+    uint32_t masks[4];
+    ncycle_t nWPTLC[8];
+    double EwrTLC[8];
+
+    /* Stats */
+    uint64_t remapWrites;
+    uint64_t remappedWords;
+    uint64_t baselinePulses;
+    uint64_t remapPulses;
+    double baselineEnergy;
+    double remapEnergy;
+    double remapLatencyReduction;
+    double remapEnergyReduction;
+
+    uint32_t Remap( uint32_t word, uint64_t mapping );
+    void WordCost( uint32_t word, uint32_t oldWord, uint64_t cells,
+                   ncycle_t& pulses, double& energy );
+};
+
+};
+
+#endif
@@ -34,6 +34,7 @@
 #include "MemControl/FRFCFS/FRFCFS.h"
 #include "src/EventQueue.h"
 #include "include/NVMainRequest.h"
+#include "include/NVMHelpers.h"
 #ifndef TRACE
 #ifdef GEM5
   #include "SimInterface/Gem5Interface/Gem5Interface.h"
@@ -43,7 +44,10 @@
   #include "sim/stat_control.hh"
 #endif
 #endif
+#include <algorithm>
 #include <iostream>
+#include <sstream>
+#include <string.h>
 #include <set>
 #include <assert.h>
 
@@ -51,35 +55,104 @@ using namespace NVM;
 
 FRFCFS::FRFCFS( )
 {
-    std::cout << "Created a First Ready First Come First Serve memory controller!"
-        << std::endl;
-	
 	//EDFPCscheme
     encodeFlag = false;
     compressIndex = 2;//0:DCW 1:FPC 2:BDI 3:DFPC
     bit_write_before = 0;
     bit_write = 0;
     
-    BDIpatterncounter = 0;
-    sample_flag = true;
     pattern_num = SAMPLECOUNT/DYNAMICWORDSIZE/2;
     threshold_factor = 0.4;
 	granularities = 5000000;
     compress_ratio = 0.0f;
     
-    mask_pos = 0;
+    dfpcEpoch = 0;
+    dfpc_relearns = 0;
+    dfpc_stale_lines = 0;
+    prunedGeneration = 0;
     
+    dfpcSampleRate = 1;
+    dfpcCheckInterval = 4096;
+    dfpcStableChecks = 8;
+    dfpcEarlyWarmup = false;
+    dfpc_sampled_writes = 0;
+    dfpc_early_warmups = 0;
+    dfpc_confidence = 0.0f;
+    dfpcPatternTable = "";
     
-	for(int i=0;i<FPCCOUNT;i++)
-		FPCCounter[i] = 0;
-	for(int i=0;i<BDICOUNT;i++)
-		BDICounter[i] = 0;
-	for(int i=0;i<SAMPLECOUNT;i++)
-		SampleCounter[i] = 0;
-    for(int i = 0; i <= BDICOUNT; i++)
-        special_pattern_flag[i] = false;
+    for(int i = 0; i < SCHEME_COUNT; i++)
+    {
+        compressLatency[i] = 0;
+        decompressLatency[i] = 0;
+    }
+    encoderLatency = 0;
+    decoderLatency = 0;
+    codecPipelined = true;
+    trackLineSchemes = false;
+    lastScheme = SCHEME_NONE;
+    
+    for(int i = 0; i < SCHEME_COUNT; i++)
+    {
+        for(int j = 0; j < PATTERN_SLOTS; j++)
+            patternHits[i][j] = 0;
+    }
+    for(int j = 0; j < PATTERN_SLOTS; j++)
+        pendingPatterns[j] = 0;
+    pendingScheme = SCHEME_NONE;
+    uncompressed_bytes = 0;
+    compressed_bytes = 0;
+    aggregate_compress_ratio = 0.0f;
+    patternHitsHisto = "";
+    fpcSizeHisto = "";
+    bdiSizeHisto = "";
+    dfpcStaticSizeHisto = "";
+    dfpcDynamicSizeHisto = "";
+    storedLineLimit = 1048576;
+    stored_line_evictions = 0;
+    compression_cycles = 0;
+    decompression_cycles = 0;
+    
+    packedLines = false;
+    lineTableLatency = 0;
+    lineTableCacheSize = 0;
+    openSlots = NULL;
+    packedRegionRows = 0;
+    packedBaseRow = 0;
+    slotsPerBank = 0;
+    packed_lines = 0;
+    packed_slots = 0;
+    line_relocations = 0;
+    line_evictions = 0;
+    packed_region_conflicts = 0;
+    line_table_misses = 0;
+    packed_dead_bytes = 0;
+    effective_capacity = 1.0f;
+    
+    jointFlipEncoding = false;
+    jointFlipGranularity = 32;
+    jointFlipMask = 0;
+    joint_raw_lines = 0;
+    joint_compressed_lines = 0;
+    joint_flipped_lines = 0;
+    joint_flipped_partitions = 0;
+    
+    verifyCompression = false;
+    verified_reads = 0;
+    roundtrip_failures = 0;
+    encoder_roundtrip_failures = 0;
+    roundtripFailureHisto = "";
+    writePauseLatencyPercentiles = "";
+    
+    dictionaries = NULL;
+    dictionaryCount = 1;
+    dictionaryScope = DICTIONARY_CHANNEL;
+    dictionaryRegionSize = 0;
 	
     queueSize = 32;
+    readQueueSize = 32;
+    writeQueueSize = 32;
+    highWaterMark = 32;
+    lowWaterMark = 16;
     starvationThreshold = 4;
 
     averageLatency = 0.0f;
@@ -92,25 +165,216 @@ FRFCFS::FRFCFS( )
 
     mem_reads = 0;
     mem_writes = 0;
+    dfpcWrites = 0;
 
     rb_hits = 0;
     rb_miss = 0;
 
     write_pauses = 0;
+    write_drains = 0;
+    read_queue_full = 0;
+    write_queue_full = 0;
 
     starvation_precharges = 0;
 
     psInterval = 0;
 
-    InitQueues( 1 );
+    InitQueues( QUEUE_COUNT );
+
+    readQueue = &(transactionQueues[READ_QUEUE]);
+    writeQueue = &(transactionQueues[WRITE_QUEUE]);
+    draining = false;
 
-    memQueue = &(transactionQueues[0]);
+    bankQueues[READ_QUEUE] = NULL;
+    bankQueues[WRITE_QUEUE] = NULL;
+    headAge = 0;
+    tailAge = 0;
+
+    compressedWriteDrain = false;
+    shortWriteThreshold = 0;
+    maxWriteDeferrals = 16;
+    long_write_deferrals = 0;
+    short_write_preferred = 0;
+
+    verifyIndexedScheduler = false;
+    indexed_schedule_mismatches = 0;
 }
 
 FRFCFS::~FRFCFS( )
 {
-    std::cout << "FRFCFS memory controller destroyed. " << memQueue->size( ) 
-              << " commands still in memory queue." << std::endl;
+    if( debugLog.Enabled( ) )
+        debugLog.Log( ) << "FRFCFS memory controller destroyed. " << readQueue->size( ) 
+                        << " reads and " << writeQueue->size( ) 
+                        << " writes still in memory queue." << std::endl;
+
+    for( ncounter_t queue = 0; queue < QUEUE_COUNT; queue++ )
+    {
+        if( bankQueues[queue] == NULL )
+            continue;
+
+        for( ncounter_t i = 0; i < p->RANKS; i++ )
+            delete [] bankQueues[queue][i];
+
+        delete [] bankQueues[queue];
+    }
+
+    if( openSlots != NULL )
+    {
+        for( ncounter_t i = 0; i < p->RANKS; i++ )
+            delete [] openSlots[i];
+
+        delete [] openSlots;
+    }
+
+    delete [] dictionaries;
+}
+
+/*
+ *  Saves the learned DFPC dictionaries and warm-up progress, the per-line
+ *  compression records and joint encoding formats, and the packed line layout. The
+ *  transaction queues are not saved; NVMain only checkpoints once they
+ *  have drained.
+ */
+void FRFCFS::SaveCheckpoint( std::ostream& out )
+{
+    CheckpointWrite( out, dfpcWrites );
+    CheckpointWrite( out, pattern_num );
+    CheckpointWrite( out, dictionaryCount );
+    for( uint64_t i = 0; i < dictionaryCount; i++ )
+        CheckpointWrite( out, dictionaries[i] );
+
+    CheckpointWrite( out, lineGeneration );
+    CheckpointWrite( out, storedLines );
+    CheckpointWrite( out, lineImages );
+    CheckpointWrite( out, jointLines );
+
+    CheckpointWrite( out, packedLines );
+    if( packedLines )
+    {
+        CheckpointWrite( out, lineTable );
+        CheckpointWrite( out, slotLines );
+        CheckpointWrite( out, p->RANKS );
+        CheckpointWrite( out, p->BANKS );
+        CheckpointWrite( out, slotsPerBank );
+        for( ncounter_t i = 0; i < p->RANKS; i++ )
+        {
+            for( ncounter_t j = 0; j < p->BANKS; j++ )
+                CheckpointWrite( out, openSlots[i][j] );
+        }
+    }
+}
+
+/*
+ *  Everything is read aside first and only swapped in once the whole record
+ *  has been read, so a short or mismatched record leaves the controller
+ *  cold rather than half restored.
+ */
+bool FRFCFS::RestoreCheckpoint( std::istream& in )
+{
+    uint64_t savedWrites, savedDictionaries;
+    uint32_t savedPatterns;
+    std::unordered_map<uint64_t, uint64_t> savedGenerations;
+    std::unordered_map<uint64_t, StoredLine> savedLines;
+    std::unordered_map<uint64_t, CompressedImage> savedImages;
+    std::unordered_map<uint64_t, JointLine> savedJointLines;
+    std::unordered_map<uint64_t, LineLocation> savedTable;
+    std::unordered_map<uint64_t, std::vector<uint64_t> > savedSlots;
+    std::vector<OpenSlot> savedOpen;
+    bool savedPacked, restoreLayout = false;
+
+    if( !CheckpointRead( in, savedWrites ) || !CheckpointRead( in, savedPatterns )
+        || !CheckpointRead( in, savedDictionaries ) )
+        return false;
+
+    /* Dictionaries only carry over with the same DFPCDictionaryScope. */
+    if( savedDictionaries != dictionaryCount )
+        return false;
+
+    std::vector<DFPCDictionary> savedDicts( dictionaryCount );
+    for( uint64_t i = 0; i < dictionaryCount; i++ )
+    {
+        if( !CheckpointRead( in, savedDicts[i] ) )
+            return false;
+    }
+
+    if( !CheckpointRead( in, savedGenerations ) || !CheckpointRead( in, savedLines )
+        || !CheckpointRead( in, savedImages ) || !CheckpointRead( in, savedJointLines )
+        || !CheckpointRead( in, savedPacked ) )
+        return false;
+
+    /* A layout saved without PackedLines leaves the line table empty. */
+    if( savedPacked )
+    {
+        ncounter_t ranks, banks;
+        uint64_t slots;
+
+        if( !CheckpointRead( in, savedTable ) || !CheckpointRead( in, savedSlots )
+            || !CheckpointRead( in, ranks ) || !CheckpointRead( in, banks )
+            || !CheckpointRead( in, slots ) )
+            return false;
+
+        restoreLayout = ( packedLines && ranks == p->RANKS && banks == p->BANKS 
+                          && slots == slotsPerBank );
+
+        for( ncounter_t i = 0; i < ranks * banks; i++ )
+        {
+            OpenSlot slot;
+
+            if( !CheckpointRead( in, slot ) )
+                return false;
+
+            if( restoreLayout )
+                savedOpen.push_back( slot );
+        }
+    }
+
+    dfpcWrites = savedWrites;
+    pattern_num = savedPatterns;
+    std::copy( savedDicts.begin( ), savedDicts.end( ), dictionaries );
+
+    lineGeneration.swap( savedGenerations );
+    storedLines.swap( savedLines );
+    lineImages.swap( savedImages );
+    jointLines.swap( savedJointLines );
+
+    if( restoreLayout )
+    {
+        lineTable.swap( savedTable );
+        slotLines.swap( savedSlots );
+        for( ncounter_t i = 0; i < savedOpen.size( ); i++ )
+            openSlots[i / p->BANKS][i % p->BANKS] = savedOpen[i];
+        lineTableCache.assign( lineTableCacheSize, ~0ULL );
+    }
+
+    return true;
+}
+
+FRFCFS::DFPCDictionary::DFPCDictionary( )
+{
+    for(int i = 0; i < FPCCOUNT; i++)
+        FPCCounter[i] = 0;
+    for(int i = 0; i < BDICOUNT; i++)
+        BDICounter[i] = 0;
+    for(int i = 0; i < SAMPLECOUNT; i++)
+        SampleCounter[i] = 0;
+    BDIpatterncounter = 0;
+    sample_flag = true;
+    epochWrites = 0;
+    ranking.Clear( );
+    
+    sampleTick = 0;
+    samples = 0;
+    for(int i = 0; i < 3; i++)
+        signature[i] = 0;
+    stableChecks = 0;
+    converged = false;
+    
+    activePatterns.mask_pos = 0;
+    activePatterns.generation = 0;
+    for(int i = 0; i <= BDICOUNT; i++)
+        activePatterns.special_pattern_flag[i] = false;
+    for(int i = 0; i < DFPCHISTORY; i++)
+        retiredPatterns[i] = activePatterns;
 }
 
 void FRFCFS::SetConfig( Config *conf, bool createChildren )
@@ -125,9 +389,158 @@ void FRFCFS::SetConfig( Config *conf, bool createChildren )
         queueSize = static_cast<unsigned int>( conf->GetValue( "QueueSize" ) );
     }
 
+    /* Without explicit per-class sizes each queue gets the full QueueSize. */
+    readQueueSize = writeQueueSize = queueSize;
+    conf->GetValueUL( "ReadQueueSize", readQueueSize );
+    conf->GetValueUL( "WriteQueueSize", writeQueueSize );
+
+    conf->GetValueUL( "DFPCWarmup", granularities );
+    conf->GetValueUL( "DFPCEpoch", dfpcEpoch );
+    conf->GetValueUL( "DFPCSampleRate", dfpcSampleRate );
+    conf->GetValueUL( "DFPCCheckInterval", dfpcCheckInterval );
+    conf->GetValueUL( "DFPCStableChecks", dfpcStableChecks );
+    conf->GetBool( "DFPCEarlyWarmup", dfpcEarlyWarmup );
+
+    if( dfpcSampleRate == 0 )
+        dfpcSampleRate = 1;
+    if( dfpcCheckInterval == 0 )
+        dfpcCheckInterval = 1;
+    if( dfpcStableChecks == 0 )
+        dfpcStableChecks = 1;
+
+    conf->GetValueUL( "FPCCompressLatency", compressLatency[SCHEME_FPC] );
+    conf->GetValueUL( "FPCDecompressLatency", decompressLatency[SCHEME_FPC] );
+    conf->GetValueUL( "BDICompressLatency", compressLatency[SCHEME_BDI] );
+    conf->GetValueUL( "BDIDecompressLatency", decompressLatency[SCHEME_BDI] );
+    conf->GetValueUL( "DFPCStaticCompressLatency", compressLatency[SCHEME_DFPC_STATIC] );
+    conf->GetValueUL( "DFPCStaticDecompressLatency", decompressLatency[SCHEME_DFPC_STATIC] );
+    conf->GetValueUL( "DFPCDynamicCompressLatency", compressLatency[SCHEME_DFPC_DYNAMIC] );
+    conf->GetValueUL( "DFPCDynamicDecompressLatency", decompressLatency[SCHEME_DFPC_DYNAMIC] );
+    conf->GetValueUL( "EncoderLatency", encoderLatency );
+    conf->GetValueUL( "DecoderLatency", decoderLatency );
+    conf->GetBool( "CodecPipelined", codecPipelined );
+    conf->GetValueUL( "StoredLineLimit", storedLineLimit );
+    conf->GetBool( "VerifyCompression", verifyCompression );
+    conf->GetBool( "VerifyIndexedScheduler", verifyIndexedScheduler );
+    conf->GetBool( "PackedLines", packedLines );
+    conf->GetBool( "JointFlipEncoding", jointFlipEncoding );
+    conf->GetValueUL( "JointFlipGranularity", jointFlipGranularity );
+
+    /* At most 64 flip flags per line. */
+    if( jointFlipGranularity < 8 )
+        jointFlipGranularity = 8;
+    conf->GetValueUL( "LineTableLatency", lineTableLatency );
+    conf->GetValueUL( "LineTableCacheSize", lineTableCacheSize );
+
+    /* Reads only need to know how a line was stored if decoding costs anything. */
+    trackLineSchemes = (decoderLatency > 0);
+    for( int i = 0; i < SCHEME_COUNT; i++ )
+    {
+        if( decompressLatency[i] > 0 )
+            trackLineSchemes = true;
+    }
+
+    if( conf->KeyExists( "DFPCDictionaryScope" ) )
+    {
+        std::string scope = conf->GetString( "DFPCDictionaryScope" );
+
+        if( scope == "Bank" )
+            dictionaryScope = DICTIONARY_BANK;
+        else if( scope == "Region" )
+            dictionaryScope = DICTIONARY_REGION;
+    }
+
+    conf->GetBool( "CompressedWriteDrain", compressedWriteDrain );
+    conf->GetValueUL( "MaxWriteDeferrals", maxWriteDeferrals );
+
     MemoryController::SetConfig( conf, createChildren );
 
+    /* Default to a quarter of the slowest possible uncompressed line write. */
+    ncycle_t slowestPulse = MAX( MAX( MAX( p->nWP000, p->nWP001 ), MAX( p->nWP010, p->nWP011 ) ),
+                                 MAX( MAX( p->nWP100, p->nWP101 ), MAX( p->nWP110, p->nWP111 ) ) );
+    ncounter_t wordsPerLine = p->BusWidth * p->tBURST * p->RATE / 32;
+    shortWriteThreshold = wordsPerLine * slowestPulse / 4;
+    conf->GetValueUL( "ShortWriteThreshold", shortWriteThreshold );
+
+    if( p->CompressedBursts )
+        trackLineSchemes = true;
+
+    LatencyHistogram::ParsePercentiles( p->LatencyPercentiles, latencyPercentiles );
+
+    highWaterMark = p->HighWaterMark;
+    lowWaterMark = p->LowWaterMark;
+
+    /* Keep LowWaterMark < HighWaterMark <= WriteQueueSize. */
+    if( p->HighWaterMark <= 0 || highWaterMark > writeQueueSize )
+    {
+        std::cerr << "FRFCFS: HighWaterMark " << p->HighWaterMark << " is outside [1, "
+                  << writeQueueSize << "]. Using " << writeQueueSize << "." << std::endl;
+        highWaterMark = writeQueueSize;
+    }
+    if( p->LowWaterMark < 0 || lowWaterMark >= highWaterMark )
+    {
+        uint64_t clamped = (highWaterMark > 0) ? highWaterMark - 1 : 0;
+
+        std::cerr << "FRFCFS: LowWaterMark " << p->LowWaterMark << " is not below HighWaterMark "
+                  << highWaterMark << ". Using " << clamped << "." << std::endl;
+        lowWaterMark = clamped;
+    }
+
+    /* Region scope interleaves DFPCRegions dictionaries every DFPCRegionSize bytes. */
+    if( dictionaryScope == DICTIONARY_BANK )
+    {
+        dictionaryCount = p->RANKS * p->BANKS;
+    }
+    else if( dictionaryScope == DICTIONARY_REGION )
+    {
+        dictionaryCount = 4;
+        dictionaryRegionSize = 1ULL << 30;
+        conf->GetValueUL( "DFPCRegions", dictionaryCount );
+        conf->GetValueUL( "DFPCRegionSize", dictionaryRegionSize );
+
+        if( dictionaryCount == 0 )
+            dictionaryCount = 1;
+        if( dictionaryRegionSize == 0 )
+            dictionaryRegionSize = 1ULL << 30;
+    }
+
+    dictionaries = new DFPCDictionary [dictionaryCount];
+
+    for( ncounter_t queue = 0; queue < QUEUE_COUNT; queue++ )
+    {
+        bankQueues[queue] = new NVMTransactionQueue * [p->RANKS];
+        for( ncounter_t i = 0; i < p->RANKS; i++ )
+            bankQueues[queue][i] = new NVMTransactionQueue [p->BANKS];
+    }
+
+    if( packedLines )
+    {
+        /* Default to a quarter of every bank for packed slots. */
+        packedRegionRows = p->ROWS / 4;
+        conf->GetValueUL( "PackedRegionRows", packedRegionRows );
+        packedRegionRows = MIN( MAX( packedRegionRows, 1 ), p->ROWS );
+        packedBaseRow = p->ROWS - packedRegionRows;
+        slotsPerBank = packedRegionRows * p->COLS;
+        lineTableCache.assign( lineTableCacheSize, ~0ULL );
+
+        openSlots = new OpenSlot * [p->RANKS];
+        for( ncounter_t i = 0; i < p->RANKS; i++ )
+        {
+            openSlots[i] = new OpenSlot [p->BANKS];
+            for( ncounter_t j = 0; j < p->BANKS; j++ )
+            {
+                openSlots[i][j].slot = 0;
+                openSlots[i][j].used = 0;
+            }
+        }
+    }
+
     SetDebugName( "FRFCFS", conf );
+
+    debugLog.SetConfig( conf, p, "FRFCFS" );
+    if( debugLog.Enabled( ) )
+        debugLog.Log( ) << "Created a First Ready First Come First Serve memory controller!"
+                        << std::endl;
 }
 
 void FRFCFS::RegisterStats( )
@@ -137,6 +550,40 @@ void FRFCFS::RegisterStats( )
     AddStat(bit_write);
     AddStat(bit_write_before);
     AddStat(compress_ratio);
+    AddStat(uncompressed_bytes);
+    AddStat(compressed_bytes);
+    AddStat(aggregate_compress_ratio);
+    AddStat(patternHitsHisto);
+    AddStat(fpcSizeHisto);
+    AddStat(bdiSizeHisto);
+    AddStat(dfpcStaticSizeHisto);
+    AddStat(dfpcDynamicSizeHisto);
+    AddStat(dfpc_relearns);
+    AddStat(dfpc_stale_lines);
+    AddStat(dfpc_sampled_writes);
+    AddStat(dfpc_early_warmups);
+    AddStat(dfpc_confidence);
+    AddStat(dfpcPatternTable);
+    AddStat(compression_cycles);
+    AddStat(stored_line_evictions);
+    AddStat(decompression_cycles);
+    AddStat(verified_reads);
+    AddStat(roundtrip_failures);
+    AddStat(encoder_roundtrip_failures);
+    AddStat(roundtripFailureHisto);
+    AddStat(writePauseLatencyPercentiles);
+    AddStat(packed_lines);
+    AddStat(packed_slots);
+    AddStat(effective_capacity);
+    AddStat(line_relocations);
+    AddStat(line_evictions);
+    AddStat(packed_region_conflicts);
+    AddStat(line_table_misses);
+    AddStat(packed_dead_bytes);
+    AddStat(joint_raw_lines);
+    AddStat(joint_compressed_lines);
+    AddStat(joint_flipped_lines);
+    AddStat(joint_flipped_partitions);
     
 	
     AddStat(mem_reads);
@@ -151,18 +598,30 @@ void FRFCFS::RegisterStats( )
     AddStat(measuredQueueLatencies);
     AddStat(measuredTotalLatencies);
     AddStat(write_pauses);
+    AddStat(write_drains);
+    AddStat(read_queue_full);
+    AddStat(write_queue_full);
+    AddStat(long_write_deferrals);
+    AddStat(short_write_preferred);
+    AddStat(indexed_schedule_mismatches);
 
     MemoryController::RegisterStats( );
 }
 
-bool FRFCFS::IsIssuable( NVMainRequest * /*request*/, FailReason * /*fail*/ )
+bool FRFCFS::IsIssuable( NVMainRequest *request, FailReason * /*fail*/ )
 {
     bool rv = true;
 
     /*
-     *  Limit the number of commands in the queue. This will stall the caches/CPU.
+     *  Limit the number of commands in each queue. A full write queue only
+     *  stalls writes, so reads keep flowing during write bursts.
      */ 
-    if( memQueue->size( ) >= queueSize )
+    if( QueueFor( request ) == READ_QUEUE )
+    {
+        if( readQueue->size( ) >= readQueueSize )
+            rv = false;
+    }
+    else if( writeQueue->size( ) + pausableWrites.size( ) >= writeQueueSize )
     {
         rv = false;
     }
@@ -176,8 +635,14 @@ bool FRFCFS::IsIssuable( NVMainRequest * /*request*/, FailReason * /*fail*/ )
  */
 bool FRFCFS::IssueCommand( NVMainRequest *req )
 {
+    /* IsIssuable is polled freely, so rejections are only counted here. */
     if( !IsIssuable( req ) )
     {
+        if( QueueFor( req ) == READ_QUEUE )
+            read_queue_full++;
+        else
+            write_queue_full++;
+
         return false;
     }
 
@@ -213,7 +678,6 @@ bool FRFCFS::IssueCommand( NVMainRequest *req )
         {
             comsize = req->data.GetComSize();
         }
-        compress_ratio += (size * 1.0 / comsize);
         /*
         if(req->data.IsCompressed())
         {
@@ -237,6 +701,12 @@ bool FRFCFS::IssueCommand( NVMainRequest *req )
             printf("\n");
         }
     */
+        bool encoded = encodeFlag && req->data.IsCompressed();
+        bool encoderRan = encoded;
+        
+        if( verifyCompression )
+            CaptureImage( req );
+        
         if(encodeFlag)
         {
             //isEncoded = GeneralEncoder(req);
@@ -269,6 +739,22 @@ bool FRFCFS::IssueCommand( NVMainRequest *req )
         //    
         //}
         
+        if( jointFlipEncoding )
+        {
+            JointEncode( req );
+            encoded = encoded && req->data.IsCompressed( );
+        }
+        
+        /* Size and pattern stats describe the line as it is finally stored. */
+        if( !req->data.IsCompressed( ) )
+            comsize = size;
+        CommitPatterns( req->data.IsCompressed( ) );
+        
+        /* compress_ratio sums the per-line ratios; aggregate_compress_ratio is the ratio of the sums. */
+        compress_ratio += (size * 1.0 / comsize);
+        uncompressed_bytes += size;
+        compressed_bytes += comsize;
+        compressedSizeMap[lastScheme][comsize]++;
         
         bitsCom = GetChanges(req, 3, false);
         bitsChange = GetChanges(req, 3, true);
@@ -282,14 +768,38 @@ bool FRFCFS::IssueCommand( NVMainRequest *req )
         bit_write_before += bitsCom;
 		bit_write += bitsChange;
         //std::cout<<"bit_write_com:"<<bit_write<<std::endl;
+        
+        SetWriteTransferSize(req);
+        SetWriteCodecLatency(req, encoderRan, encoded);
+        
+        if( verifyCompression )
+            StoreImage( req, encoded );
+        
+        if( packedLines )
+            PlaceLine( req );
 	}
+    else if( req->type == READ )
+    {
+        SetReadCodecLatency( req );
+        
+        if( verifyCompression )
+            VerifyRead( req );
+        
+        if( packedLines )
+            LocateLine( req );
+    }
 	 
-    Enqueue( 0, req );
+    EnqueueIndexed( req );
 
     if( req->type == READ )
+    {
         mem_reads++;
+    }
     else
+    {
         mem_writes++;
+        dfpcWrites++;
+    }
 
     /*
      *  Return whether the request could be queued. Return false if the queue is full.
@@ -301,6 +811,9 @@ bool FRFCFS::RequestComplete( NVMainRequest * request )
 {
     if( request->type == WRITE || request->type == WRITE_PRECHARGE )
     {
+        /* Either back in the queue or done, so give up the reserved slot. */
+        pausableWrites.erase( request );
+
         /* 
          *  Put cancelled requests at the head of the write queue
          *  like nothing ever happened.
@@ -308,7 +821,13 @@ bool FRFCFS::RequestComplete( NVMainRequest * request )
         if( request->flags & NVMainRequest::FLAG_CANCELLED 
             || request->flags & NVMainRequest::FLAG_PAUSED )
         {
-            Prequeue( 0, request );
+            if( interruptedWrites.count( request ) == 0 )
+                interruptedWrites[request] = request->issueCycle;
+
+            /* The line was already compressed and encoded; only the cell write restarts. */
+            request->data.SetCodecLatency( 0 );
+
+            PrequeueIndexed( request );
 
             return true;
         }
@@ -341,122 +860,1092 @@ bool FRFCFS::RequestComplete( NVMainRequest * request )
                                 - static_cast<double>(request->arrivalCycle))
                             / static_cast<double>(measuredTotalLatencies+1);
         measuredTotalLatencies += 1;
+
+        if( request->type == WRITE || request->type == WRITE_PRECHARGE )
+            RecordWritePause( request );
     }
 
     return MemoryController::RequestComplete( request );
 }
 
+void FRFCFS::RecordWritePause( NVMainRequest *request )
+{
+    std::unordered_map<NVMainRequest *, ncycle_t>::iterator it = interruptedWrites.find( request );
+    ncycle_t pause = 0;
+
+    if( it != interruptedWrites.end( ) )
+    {
+        if( request->issueCycle > it->second )
+            pause = request->issueCycle - it->second;
+
+        interruptedWrites.erase( it );
+    }
+
+    writePauseLatency.Record( pause );
+}
+
 void FRFCFS::Cycle( ncycle_t steps )
 {
     NVMainRequest *nextRequest = NULL;
 
+    /* Enter write drain at the high watermark and leave it at the low one. */
+    if( !draining && writeQueue->size( ) >= highWaterMark && !writeQueue->empty( ) )
+    {
+        draining = true;
+        write_drains++;
+    }
+    else if( draining && writeQueue->size( ) <= lowWaterMark )
+    {
+        draining = false;
+    }
+
+    /*
+     *  Reads bypass buffered writes unless a drain is in progress. Writes are
+     *  still issued when no read can go, and reads fill in while a drain has
+     *  nothing ready. Long writes held back for reads on their bank go last,
+     *  so those reads are served first even during a drain.
+     */
+    if( draining )
+    {
+        if( !ScheduleQueue( WRITE_QUEUE, &nextRequest ) 
+            && !ScheduleQueue( READ_QUEUE, &nextRequest ) )
+            ScheduleDeferredWrites( &nextRequest );
+    }
+    else
+    {
+        if( !ScheduleQueue( READ_QUEUE, &nextRequest ) 
+            && !ScheduleQueue( WRITE_QUEUE, &nextRequest ) )
+            ScheduleDeferredWrites( &nextRequest );
+    }
+
+    /* Issue the commands for this transaction. */
+    if( nextRequest != NULL )
+    {
+        IssueMemoryCommands( nextRequest );
+
+        if( p->WritePausing && QueueFor( nextRequest ) == WRITE_QUEUE )
+            pausableWrites.insert( nextRequest );
+    }
+
+    ChargeDeferrals( nextRequest );
+
+    /* Issue any commands in the command queues. */
+    CycleCommandQueues( );
+
+    MemoryController::Cycle( steps );
+}
+
+bool FRFCFS::ScheduleQueue( ncounter_t queue, NVMainRequest **nextRequest )
+{
+    NVMTransactionQueue& transactionQueue = transactionQueues[queue];
+
+    *nextRequest = NULL;
+
+    if( transactionQueue.empty( ) )
+        return false;
+
     /* Check for starved requests BEFORE row buffer hits. */
-    if( FindStarvedRequest( *memQueue, &nextRequest ) )
+    if( FindStarvedRequest( transactionQueue, nextRequest ) )
     {
+        RemoveIndexed( *nextRequest );
         rb_miss++;
         starvation_precharges++;
     }
     /* Check for row buffer hits. */
-    else if( FindRowBufferHit( *memQueue, &nextRequest) )
+    else if( FindIndexedRequest( queue, SEARCH_ROW_HIT, true, nextRequest ) )
     {
         rb_hits++;
     }
     /* Check if the address is accessible through any other means. */
-    else if( FindCachedAddress( *memQueue, &nextRequest ) )
+    else if( FindCachedAddress( transactionQueue, nextRequest ) )
     {
+        RemoveIndexed( *nextRequest );
     }
-    else if( FindWriteStalledRead( *memQueue, &nextRequest ) )
+    else if( queue == READ_QUEUE 
+             && FindWriteStalledRead( transactionQueue, nextRequest ) )
     {
-        if( nextRequest != NULL )
+        if( *nextRequest != NULL )
+        {
+            RemoveIndexed( *nextRequest );
             write_pauses++;
+        }
     }
     /* Find the oldest request that can be issued. */
-    else if( FindOldestReadyRequest( *memQueue, &nextRequest ) )
+    else if( FindIndexedRequest( queue, SEARCH_OLDEST_READY, true, nextRequest ) )
     {
         rb_miss++;
     }
     /* Find requests to a bank that is closed. */
-    else if( FindClosedBankRequest( *memQueue, &nextRequest ) )
+    else if( FindIndexedRequest( queue, SEARCH_CLOSED_BANK, true, nextRequest ) )
     {
         rb_miss++;
     }
     else
     {
-        nextRequest = NULL;
+        *nextRequest = NULL;
     }
 
-    /* Issue the commands for this transaction. */
-    if( nextRequest != NULL )
+    return (*nextRequest != NULL);
+}
+
+/*
+ *  Only long writes held back for waiting reads are left, so let them
+ *  through in the same search order.
+ */
+bool FRFCFS::ScheduleDeferredWrites( NVMainRequest **nextRequest )
+{
+    *nextRequest = NULL;
+
+    if( deferredWrites.empty( ) )
+        return false;
+
+    if( FindIndexedRequest( WRITE_QUEUE, SEARCH_ROW_HIT, false, nextRequest ) )
     {
-        IssueMemoryCommands( nextRequest );
+        rb_hits++;
+    }
+    else if( FindIndexedRequest( WRITE_QUEUE, SEARCH_OLDEST_READY, false, nextRequest ) )
+    {
+        rb_miss++;
+    }
+    else if( FindIndexedRequest( WRITE_QUEUE, SEARCH_CLOSED_BANK, false, nextRequest ) )
+    {
+        rb_miss++;
     }
 
-    /* Issue any commands in the command queues. */
-    CycleCommandQueues( );
-
-    MemoryController::Cycle( steps );
+    return (*nextRequest != NULL);
 }
 
-void FRFCFS::CalculateStats( )
+/*
+ *  Everything that is not a read (writes and any other transaction types)
+ *  is buffered in the write queue.
+ */
+ncounter_t FRFCFS::QueueFor( NVMainRequest *req )
 {
-    MemoryController::CalculateStats( );
+    if( req->type == READ || req->type == READ_PRECHARGE )
+        return READ_QUEUE;
+
+    return WRITE_QUEUE;
 }
 
+void FRFCFS::EnqueueIndexed( NVMainRequest *req )
+{
+    uint64_t rank, bank;
+    IndexedTransaction entry;
+
+    req->address.GetTranslatedAddress( NULL, NULL, &bank, &rank, NULL, NULL );
 
+    entry.queue = QueueFor( req );
 
-//EDFPCscheme
+    Enqueue( entry.queue, req );
 
-uint64_t FRFCFS::my_llabs ( int64_t x )
-{
-    uint64_t t = x >> 63;
-    return (x ^ t) - t;
+    entry.position = --transactionQueues[entry.queue].end( );
+    entry.age = tailAge++;
+    entry.writeEstimate = (req->type == WRITE) ? EstimateWriteLatency( req ) : 0;
+    entry.deferrals = 0;
+    indexedTransactions[req] = entry;
+
+    bankQueues[entry.queue][rank][bank].push_back( req );
 }
 
-uint64_t FRFCFS::my_abs ( int x )
+void FRFCFS::PrequeueIndexed( NVMainRequest *req )
 {
-    uint64_t t = x >> 31;
-    return (x ^ t) - t;
+    uint64_t rank, bank;
+    IndexedTransaction entry;
+
+    req->address.GetTranslatedAddress( NULL, NULL, &bank, &rank, NULL, NULL );
+
+    entry.queue = QueueFor( req );
+
+    Prequeue( entry.queue, req );
+
+    entry.position = transactionQueues[entry.queue].begin( );
+    entry.age = --headAge;
+    entry.writeEstimate = (req->flags & NVMainRequest::FLAG_PAUSED) 
+                        ? req->writeProgress : EstimateWriteLatency( req );
+    entry.deferrals = 0;
+    indexedTransactions[req] = entry;
+
+    bankQueues[entry.queue][rank][bank].push_front( req );
 }
 
-uint64_t * FRFCFS::convertByte2Word (NVMainRequest *request, bool flag, uint64_t size, uint64_t step)//flag: false-olddata true-newdata
+/*
+ *  Drop a request that the base class already removed from its transaction
+ *  queue. Only the index is touched since the stored queue position is no
+ *  longer valid.
+ */
+void FRFCFS::RemoveIndexed( NVMainRequest *req )
 {
-    uint64_t * values = (uint64_t *) malloc(sizeof(uint64_t) * size/step);
-    uint64_t i,j; 
-    for (i = 0; i < size / step; i++) {
-        values[i] = 0;    // Initialize all elements to zero.
-    }
-    
-    for (i = 0; i < size; i += step ){
-        for (j = 0; j < step; j++){
-            if(flag)
-                values[i / step] += (uint64_t)(request->data.GetByte(i + j) << (8*j));
-            else
-                values[i / step] += (uint64_t)(request->oldData.GetByte(i + j) << (8*j));
-                
-        }
-    }
-    return values;
+    uint64_t rank, bank;
+    ncounter_t queue = QueueFor( req );
+
+    req->address.GetTranslatedAddress( NULL, NULL, &bank, &rank, NULL, NULL );
+
+    indexedTransactions.erase( req );
+    bankQueues[queue][rank][bank].remove( req );
 }
 
-uint64_t FRFCFS::GetChanges (NVMainRequest *request, uint32_t MLCLevels, bool DCWFlag)
+/*
+ *  With deferLongWrites, long writes to banks with reads waiting are held
+ *  back and remembered in deferredWrites. ScheduleQueue only searches
+ *  without it once every search has come up empty.
+ */
+bool FRFCFS::FindIndexedRequest( ncounter_t queue, IndexedSearch search, 
+                                 bool deferLongWrites, NVMainRequest **nextRequest )
 {
-    uint32_t *rawData = NULL;
-    uint32_t *oldData = NULL;
-    uint64_t memoryWordSize = 64*8;
-    uint64_t size = 0;
-    uint64_t bitsChange = 0;
-    uint64_t cellsChange = 0;
-    if(request->data.IsCompressed())
-    {
-        rawData = reinterpret_cast<uint32_t*>(request->data.comData);
-        memoryWordSize = request->data.GetComSize()*8;
-    }
-    else
-    {
-        rawData = reinterpret_cast<uint32_t*>(request->data.rawData);
-    }
-    
-    if(request->oldData.IsCompressed())
+    NVMTransactionQueue::iterator it, best;
+    ncounter_t bestRank = 0, bestBank = 0;
+    int64_t bestAge = 0;
+    bool found = false;
+    bool deferred = false;
+    ncycle_t currentCycle = GetEventQueue( )->GetCurrentCycle( );
+
+    *nextRequest = NULL;
+
+    for( ncounter_t rank = 0; rank < p->RANKS; rank++ )
+    {
+        for( ncounter_t bank = 0; bank < p->BANKS; bank++ )
+        {
+            NVMTransactionQueue& bankQueue = bankQueues[queue][rank][bank];
+
+            /* Don't get in the way of refreshes, including queued ones. */
+            if( bankQueue.empty( ) || bankNeedRefresh[rank][bank] 
+                || refreshQueued[rank][bank] )
+                continue;
+
+            /* Hits and ready requests need an open row, the rest a closed bank. */
+            if( search == SEARCH_CLOSED_BANK && activateQueued[rank][bank] )
+                continue;
+            else if( search != SEARCH_CLOSED_BANK && !activateQueued[rank][bank] )
+                continue;
+
+            for( it = bankQueue.begin( ); it != bankQueue.end( ); it++ )
+            {
+                uint64_t row, col, subarray;
+
+                (*it)->address.GetTranslatedAddress( &row, &col, NULL, NULL, NULL, &subarray );
+
+                if( !commandQueues[GetCommandQueueId( (*it)->address )].empty( ) )
+                    continue;
+
+                /* Forces a minimum queueing latency of one cycle. */
+                if( (*it)->arrivalCycle == currentCycle )
+                    continue;
+
+                /* A hit needs the subarray open on this row and mux level. */
+                if( search == SEARCH_ROW_HIT 
+                    && ( !activeSubArray[rank][bank][subarray]
+                         || effectiveRow[rank][bank][subarray] != row
+                         || effectiveMuxedRow[rank][bank][subarray] != col / p->RBSize ) )
+                    continue;
+
+                IndexedTransaction& entry = indexedTransactions[*it];
+
+                if( deferLongWrites && DeferWrite( *it, entry, rank, bank ) )
+                {
+                    deferred = true;
+
+                    if( std::find( deferredWrites.begin( ), deferredWrites.end( ), *it ) 
+                        == deferredWrites.end( ) )
+                        deferredWrites.push_back( *it );
+
+                    continue;
+                }
+
+                /* Bank queues are age ordered, so this is the oldest match in the bank. */
+                if( !found || entry.age < bestAge )
+                {
+                    found = true;
+                    best = it;
+                    bestAge = entry.age;
+                    bestRank = rank;
+                    bestBank = bank;
+                }
+
+                break;
+            }
+        }
+    }
+
+    /* Deferring long writes is meant to differ from the linear order. */
+    if( verifyIndexedScheduler && !deferred )
+        VerifyIndexedRequest( queue, search, found ? *best : NULL );
+
+    if( found )
+    {
+        *nextRequest = *best;
+
+        if( compressedWriteDrain && (*best)->type == WRITE 
+            && !bankQueues[READ_QUEUE][bestRank][bestBank].empty( )
+            && indexedTransactions[*best].writeEstimate <= shortWriteThreshold )
+        {
+            short_write_preferred++;
+        }
+
+        transactionQueues[queue].erase( indexedTransactions[*best].position );
+        indexedTransactions.erase( *best );
+        bankQueues[queue][bestRank][bestBank].erase( best );
+    }
+
+    return found;
+}
+
+/*
+ *  Runs the linear MemoryController search the index replaces on a copy of
+ *  the queue (the linear searches remove what they find) and checks that it
+ *  picks the same request.
+ */
+void FRFCFS::VerifyIndexedRequest( ncounter_t queue, IndexedSearch search, 
+                                   NVMainRequest *indexed )
+{
+    NVMTransactionQueue linearQueue( transactionQueues[queue] );
+    NVMainRequest *linear = NULL;
+
+    if( search == SEARCH_ROW_HIT )
+        FindRowBufferHit( linearQueue, &linear );
+    else if( search == SEARCH_OLDEST_READY )
+        FindOldestReadyRequest( linearQueue, &linear );
+    else
+        FindClosedBankRequest( linearQueue, &linear );
+
+    if( linear != indexed )
+    {
+        indexed_schedule_mismatches++;
+
+        if( debugLog.Enabled( ) )
+        {
+            debugLog.Log( ) << "FRFCFS: indexed search " << search << " picked " 
+                            << indexed << ", linear search picked " << linear 
+                            << " at cycle " << GetEventQueue( )->GetCurrentCycle( ) 
+                            << std::endl;
+        }
+    }
+
+    assert( linear == indexed );
+}
+
+/*
+ *  Long writes hold the bank for the whole cell programming time. While reads
+ *  are waiting on the same bank, let them (and short compressed writes) go
+ *  first. A write is only passed over maxWriteDeferrals times.
+ */
+bool FRFCFS::DeferWrite( NVMainRequest *req, IndexedTransaction& entry,
+                         ncounter_t rank, ncounter_t bank )
+{
+    if( !compressedWriteDrain || req->type != WRITE 
+        || bankQueues[READ_QUEUE][rank][bank].empty( ) )
+        return false;
+
+    return ( entry.writeEstimate > shortWriteThreshold 
+             && entry.deferrals < maxWriteDeferrals );
+}
+
+/*
+ *  A deferral only counts against a write when another transaction was
+ *  actually issued in its place this cycle, not for every search that
+ *  skipped it.
+ */
+void FRFCFS::ChargeDeferrals( NVMainRequest *issued )
+{
+    std::vector<NVMainRequest *>::iterator it;
+
+    if( issued != NULL )
+    {
+        for( it = deferredWrites.begin( ); it != deferredWrites.end( ); it++ )
+        {
+            std::map<NVMainRequest *, IndexedTransaction>::iterator entry;
+
+            if( *it == issued )
+                continue;
+
+            entry = indexedTransactions.find( *it );
+            if( entry != indexedTransactions.end( ) )
+            {
+                entry->second.deferrals++;
+                long_write_deferrals++;
+            }
+        }
+    }
+
+    deferredWrites.clear( );
+}
+
+/*
+ *  Estimate the cell programming time of a write the same way SubArray does
+ *  for TLC: the slowest changed cell of each 32-bit word, summed over the
+ *  (possibly compressed) payload.
+ */
+ncycle_t FRFCFS::EstimateWriteLatency( NVMainRequest *request )
+{
+    uint32_t *rawData = NULL;
+    uint32_t *oldData = NULL;
+    uint64_t memoryWordSize = request->data.GetSize( ) * 8;
+    ncycle_t estimate = 0;
+    ncycle_t nWPTLC[8];
+
+    if( p->MLCLevels != 3 || p->UniformWrites )
+        return p->tWP;
+
+    nWPTLC[0] = p->nWP000;
+    nWPTLC[1] = p->nWP001;
+    nWPTLC[2] = p->nWP010;
+    nWPTLC[3] = p->nWP011;
+    nWPTLC[4] = p->nWP100;
+    nWPTLC[5] = p->nWP101;
+    nWPTLC[6] = p->nWP110;
+    nWPTLC[7] = p->nWP111;
+
+    if( request->data.IsCompressed( ) )
+    {
+        rawData = reinterpret_cast<uint32_t*>(request->data.comData);
+        memoryWordSize = request->data.GetComSize( ) * 8;
+    }
+    else
+    {
+        rawData = reinterpret_cast<uint32_t*>(request->data.rawData);
+    }
+
+    if( request->oldData.IsCompressed( ) )
+        oldData = reinterpret_cast<uint32_t*>(request->oldData.comData);
+    else
+        oldData = reinterpret_cast<uint32_t*>(request->oldData.rawData);
+
+    if( rawData == NULL || oldData == NULL )
+        return p->tWP;
+
+    uint64_t fullWords = memoryWordSize / 32;
+    uint64_t tailBits = memoryWordSize % 32;
+
+    for( uint64_t i = 0; i < fullWords + (tailBits ? 1 : 0); i++ )
+    {
+        uint32_t word = rawData[i];
+        uint32_t oldWord = oldData[i];
+        ncounter_t firstCell = 0;
+        ncycle_t delay = 0;
+
+        /* A partial word only programs its upper cells. */
+        if( i == fullWords )
+        {
+            ncounter_t cells = tailBits / 3 + ((tailBits % 3) ? 1 : 0);
+            firstCell = 11 - cells;
+            word >>= 3 * firstCell;
+            oldWord >>= 3 * firstCell;
+        }
+
+        for( ncounter_t cell = firstCell; cell < 11; cell++ )
+        {
+            if( (word & 0x7) != (oldWord & 0x7) && nWPTLC[word & 0x7] > delay )
+                delay = nWPTLC[word & 0x7];
+
+            word >>= 3;
+            oldWord >>= 3;
+        }
+
+        estimate += delay;
+    }
+
+    return estimate;
+}
+
+/*
+ *  A pipelined codec streams words alongside the bus burst, so only the part
+ *  of its latency that does not fit under the line's burst is exposed.
+ */
+ncycle_t FRFCFS::ExposedCodecLatency( NVMainRequest *req, ncycle_t latency )
+{
+    ncycle_t burst = p->BurstCycles( req->data.GetTransferSize( ) );
+
+    if( !codecPipelined )
+        return latency;
+
+    return (latency > burst) ? latency - burst : 0;
+}
+
+/*
+ *  The compressor (and the encoder, for compressed lines) runs on every
+ *  write, so its latency is charged even when the line ends up stored raw.
+ */
+void FRFCFS::SetWriteCodecLatency( NVMainRequest *req, bool encoderRan, bool encoded )
+{
+    CompressionScheme scheme = req->data.IsCompressed( ) ? lastScheme : SCHEME_NONE;
+    CompressionScheme compressor = (compressIndex == 0) ? SCHEME_NONE : lastScheme;
+    ncycle_t latency = ExposedCodecLatency( req, compressLatency[compressor] 
+                                            + (encoderRan ? encoderLatency : 0) );
+
+    req->data.SetCodecLatency( latency );
+    compression_cycles += latency;
+
+    if( trackLineSchemes )
+    {
+        uint64_t address = req->address.GetPhysicalAddress( );
+
+        /* Raw lines read back the same as lines that were never recorded. */
+        if( scheme == SCHEME_NONE && !encoded )
+        {
+            storedLines.erase( address );
+            return;
+        }
+
+        /* Past the limit an arbitrary line is forgotten and is read back as raw. */
+        if( storedLineLimit > 0 && storedLines.size( ) >= storedLineLimit
+            && storedLines.count( address ) == 0 )
+        {
+            storedLines.erase( storedLines.begin( ) );
+            stored_line_evictions++;
+        }
+
+        StoredLine& line = storedLines[address];
+
+        line.scheme = static_cast<uint8_t>( scheme );
+        line.encoded = encoded;
+        line.size = static_cast<uint8_t>( req->data.GetTransferSize( ) );
+    }
+}
+
+/*
+ *  Reads pay to decode the line the way it was last written. Lines never
+ *  written through this controller are assumed uncompressed.
+ */
+void FRFCFS::SetReadCodecLatency( NVMainRequest *req )
+{
+    std::unordered_map<uint64_t, StoredLine>::iterator it;
+    ncycle_t latency = 0;
+
+    if( !trackLineSchemes )
+        return;
+
+    it = storedLines.find( req->address.GetPhysicalAddress( ) );
+    if( it != storedLines.end( ) )
+    {
+        latency = decompressLatency[it->second.scheme];
+        if( it->second.encoded )
+            latency += decoderLatency;
+
+        req->data.SetTransferSize( it->second.size );
+    }
+
+    latency = ExposedCodecLatency( req, latency );
+    req->data.SetCodecLatency( latency );
+    decompression_cycles += latency;
+}
+
+/*
+ *  A compressed line only needs its compressed bytes on the bus.
+ */
+void FRFCFS::SetWriteTransferSize( NVMainRequest *req )
+{
+    if( req->data.IsCompressed( ) && req->data.GetComSize( ) < req->data.GetSize( ) )
+        req->data.SetTransferSize( req->data.GetComSize( ) );
+    else
+        req->data.SetTransferSize( 0 );
+}
+
+/*
+ *  Keep the compressed image of the new data before the TLC encoder rewrites
+ *  it in place. Word2Byte and DynamicCompress have already filled in the
+ *  codeword lengths and the DFPC format.
+ */
+void FRFCFS::CaptureImage( NVMainRequest *req )
+{
+    uint64_t i;
+
+    writeImage.scheme = static_cast<uint8_t>( req->data.IsCompressed( ) ? lastScheme : SCHEME_NONE );
+    writeImage.half = req->data.IsHalf( );
+    writeImage.comSize = req->data.GetComSize( );
+    writeImage.encoded = false;
+    writeImage.encodedSize = 0;
+
+    for( i = 0; i < writeImage.comSize && i < DFPCLINESIZE; i++ )
+        writeImage.bytes[i] = req->data.GetComByte( i );
+}
+
+void FRFCFS::StoreImage( NVMainRequest *req, bool encoded )
+{
+    uint64_t address = req->address.GetPhysicalAddress( );
+    uint64_t i;
+
+    /* Uncompressed lines are stored as they are; there is nothing to decode. */
+    if( writeImage.scheme == SCHEME_NONE || !req->data.IsCompressed( ) )
+    {
+        lineImages.erase( address );
+        return;
+    }
+
+    /* The encoder leaves lines above 48 compressed bytes untouched. */
+    if( encoded && writeImage.comSize <= 48 )
+    {
+        writeImage.encoded = true;
+        writeImage.encodedSize = req->data.GetComSize( );
+        for( i = 0; i < writeImage.encodedSize && i < DFPCLINESIZE; i++ )
+            writeImage.encodedBytes[i] = req->data.GetComByte( i );
+
+        /* Keep the cells as the encoder produced them, before any flips. */
+        for( i = 0; jointFlipEncoding && i < 64; i++ )
+        {
+            if( (jointFlipMask >> i) & 0x1 )
+                FlipPayload( writeImage.encodedBytes, i, writeImage.encodedSize * 8 );
+        }
+    }
+
+    lineImages[address] = writeImage;
+}
+
+/*
+ *  Decompress the stored image of the line being read and compare it with
+ *  the data the read returns. Encoded lines first have their TLC cells
+ *  decoded and checked against the compressed bytes.
+ */
+void FRFCFS::VerifyRead( NVMainRequest *req )
+{
+    std::unordered_map<uint64_t, CompressedImage>::iterator it;
+    uint8_t line[DFPCLINESIZE];
+    uint8_t bytes[DFPCLINESIZE];
+    bool match;
+    uint64_t i;
+
+    if( !req->data.IsValid( ) )
+        return;
+
+    it = lineImages.find( req->address.GetPhysicalAddress( ) );
+    if( it == lineImages.end( ) )
+        return;
+
+    const CompressedImage& image = it->second;
+
+    verified_reads++;
+
+    if( image.encoded )
+    {
+        match = DecodeCells( image, bytes );
+        for( i = 0; match && i < image.comSize; i++ )
+            match = (bytes[i] == image.bytes[i]);
+
+        if( !match )
+            encoder_roundtrip_failures++;
+    }
+
+    match = DecompressImage( image, line );
+    for( i = 0; match && i < DFPCLINESIZE; i++ )
+        match = (line[i] == req->data.GetByte( i ));
+
+    if( !match )
+    {
+        roundtrip_failures++;
+        roundtripFailureMap[image.scheme]++;
+    }
+}
+
+/*
+ *  Give a written line a place in its bank's packed slots. A line keeps its
+ *  location while it still fits; otherwise its old space is left dead and
+ *  the line is appended to the bank's open slot. Compaction of dead space
+ *  is not modeled, so the allocator wraps around at the end of the bank.
+ */
+void FRFCFS::PlaceLine( NVMainRequest *req )
+{
+    uint64_t address = req->address.GetPhysicalAddress( );
+    uint64_t size = req->data.GetSize( );
+    uint64_t rank, bank;
+    std::unordered_map<uint64_t, LineLocation>::iterator it;
+    ncycle_t latency = LineTableLookup( address );
+
+    if( req->data.IsCompressed( ) && req->data.GetComSize( ) < size )
+        size = req->data.GetComSize( );
+    if( size > DFPCLINESIZE )
+        size = DFPCLINESIZE;
+
+    it = lineTable.find( address );
+    if( it != lineTable.end( ) )
+    {
+        if( size <= it->second.space )
+        {
+            MapToSlot( req, it->second.slot );
+            req->data.SetCodecLatency( req->data.GetCodecLatency( ) + latency );
+            return;
+        }
+
+        uint64_t oldKey = SlotKey( req, it->second.slot );
+        std::vector<uint64_t>& oldLines = slotLines[oldKey];
+
+        packed_dead_bytes += it->second.space;
+        line_relocations++;
+        oldLines.erase( std::find( oldLines.begin( ), oldLines.end( ), address ) );
+        if( oldLines.empty( ) )
+            slotLines.erase( oldKey );
+    }
+
+    req->address.GetTranslatedAddress( NULL, NULL, &bank, &rank, NULL, NULL );
+    OpenSlot& open = openSlots[rank][bank];
+
+    if( open.used + size > DFPCLINESIZE )
+    {
+        open.slot = (open.slot + 1) % slotsPerBank;
+        open.used = 0;
+
+        /* Once the region wraps around, the next slot may still hold lines. */
+        EvictSlot( req, open.slot );
+    }
+
+    LineLocation& location = lineTable[address];
+
+    location.slot = open.slot;
+    location.offset = static_cast<uint8_t>( open.used );
+    location.space = static_cast<uint8_t>( size );
+    open.used += size;
+    slotLines[SlotKey( req, open.slot )].push_back( address );
+
+    MapToSlot( req, location.slot );
+    req->data.SetCodecLatency( req->data.GetCodecLatency( ) + latency );
+}
+
+/*
+ *  Lines still in a slot that is being reused go back to their home
+ *  location. The write-back traffic of the eviction is not modeled.
+ */
+void FRFCFS::EvictSlot( NVMainRequest *req, uint64_t slot )
+{
+    std::unordered_map<uint64_t, std::vector<uint64_t> >::iterator it;
+
+    it = slotLines.find( SlotKey( req, slot ) );
+    if( it == slotLines.end( ) )
+        return;
+
+    for( size_t i = 0; i < it->second.size( ); i++ )
+    {
+        lineTable.erase( it->second[i] );
+        line_evictions++;
+    }
+
+    slotLines.erase( it );
+}
+
+/*
+ *  Reads of packed lines go to the slot holding the line. Lines that were
+ *  never written through the table (or were evicted) stay at their home
+ *  location.
+ */
+void FRFCFS::LocateLine( NVMainRequest *req )
+{
+    uint64_t address = req->address.GetPhysicalAddress( );
+    std::unordered_map<uint64_t, LineLocation>::iterator it;
+    ncycle_t latency = LineTableLookup( address );
+    uint64_t row;
+
+    it = lineTable.find( address );
+    if( it != lineTable.end( ) )
+    {
+        MapToSlot( req, it->second.slot );
+    }
+    else
+    {
+        req->address.GetTranslatedAddress( &row, NULL, NULL, NULL, NULL, NULL );
+        if( row >= packedBaseRow )
+            packed_region_conflicts++;
+    }
+
+    req->data.SetCodecLatency( req->data.GetCodecLatency( ) + latency );
+}
+
+void FRFCFS::MapToSlot( NVMainRequest *req, uint64_t slot )
+{
+    uint64_t row, col, bank, rank, channel, subarray;
+
+    req->address.GetTranslatedAddress( &row, &col, &bank, &rank, &channel, &subarray );
+
+    row = packedBaseRow + slot / p->COLS;
+    col = slot % p->COLS;
+    subarray = row / p->MATHeight;
+
+    req->address.SetTranslatedAddress( row, col, bank, rank, channel, subarray );
+}
+
+uint64_t FRFCFS::SlotKey( NVMainRequest *req, uint64_t slot )
+{
+    uint64_t bank, rank;
+
+    req->address.GetTranslatedAddress( NULL, NULL, &bank, &rank, NULL, NULL );
+
+    return (rank * p->BANKS + bank) * slotsPerBank + slot;
+}
+
+/*
+ *  One metadata cache entry covers the table entries of a 4KB page. Without
+ *  a cache every lookup goes to the table in memory.
+ */
+ncycle_t FRFCFS::LineTableLookup( uint64_t address )
+{
+    uint64_t page = address >> 12;
+
+    if( lineTableCacheSize > 0 )
+    {
+        uint64_t& entry = lineTableCache[page % lineTableCacheSize];
+
+        if( entry == page )
+            return 0;
+        entry = page;
+    }
+
+    line_table_misses++;
+    return lineTableLatency;
+}
+
+/*
+ *  Pick the cheapest way to store a compressed line by TLC cell changes
+ *  against the old data: raw, compressed, or compressed with some payload
+ *  partitions inverted. Partitions are flipped greedily, and each flipped
+ *  partition costs one flag bit.
+ */
+void FRFCFS::JointEncode( NVMainRequest *req )
+{
+    uint8_t flipped[DFPCLINESIZE];
+    uint32_t *oldWords;
+    uint64_t rawCost, comCost, flipCost, cost;
+    uint64_t bits, partitions, mask, flags, i;
+    uint64_t address = req->address.GetPhysicalAddress( );
+    uint64_t oldMask = 0;
+
+    jointFlipMask = 0;
+
+    /* 
+     *  Bring the old line to its stored form: raw, or the compressed payload
+     *  with the partitions it was flipped in. A line stored compressed whose
+     *  old data no longer compresses can only be approximated by raw.
+     */
+    std::unordered_map<uint64_t, JointLine>::iterator stored = jointLines.find( address );
+    if( stored != jointLines.end( ) )
+    {
+        if( !stored->second.compressed || !req->oldData.IsCompressed( ) )
+        {
+            req->oldData.SetComFlag( false );
+        }
+        else
+        {
+            oldMask = stored->second.flipMask;
+
+            for( i = 0; i < 64; i++ )
+            {
+                if( (oldMask >> i) & 0x1 )
+                    FlipPayload( req->oldData.comData, i, req->oldData.GetComSize( ) * 8 );
+            }
+        }
+    }
+
+    JointLine& line = jointLines[address];
+
+    if( !req->data.IsCompressed( ) )
+    {
+        line.compressed = false;
+        line.flipMask = 0;
+        joint_raw_lines++;
+        return;
+    }
+
+    bits = req->data.GetComSize( ) * 8;
+    partitions = MIN( (bits + jointFlipGranularity - 1) / jointFlipGranularity, 64 );
+
+    /* Flag bits are stored in TLC cells too, so they are priced in cell changes. */
+    comCost = GetChanges( req, 3, true ) + FlagCellChanges( 0, oldMask );
+
+    req->data.SetComFlag( false );
+    rawCost = GetChanges( req, 3, true ) + FlagCellChanges( 0, oldMask );
+    req->data.SetComFlag( true );
+
+    if( req->oldData.IsCompressed( ) )
+        oldWords = reinterpret_cast<uint32_t*>( req->oldData.comData );
+    else
+        oldWords = reinterpret_cast<uint32_t*>( req->oldData.rawData );
+
+    memcpy( flipped, req->data.comData, DFPCLINESIZE );
+    flipCost = comCost;
+    mask = 0;
+    flags = 0;
+
+    for( i = 0; i < partitions; i++ )
+    {
+        FlipPayload( flipped, i, bits );
+        cost = CellChanges( reinterpret_cast<uint32_t*>( flipped ), oldWords, bits, 3 ) 
+             + FlagCellChanges( mask | (1ULL << i), oldMask );
+
+        if( cost < flipCost )
+        {
+            flipCost = cost;
+            mask |= (1ULL << i);
+            flags++;
+        }
+        else
+        {
+            FlipPayload( flipped, i, bits );
+        }
+    }
+
+    if( rawCost < comCost && rawCost < flipCost )
+    {
+        req->data.SetComFlag( false );
+        joint_raw_lines++;
+    }
+    else if( flipCost < comCost )
+    {
+        memcpy( req->data.comData, flipped, DFPCLINESIZE );
+        jointFlipMask = mask;
+        joint_flipped_lines++;
+        joint_flipped_partitions += flags;
+    }
+    else
+    {
+        joint_compressed_lines++;
+    }
+
+    line.compressed = req->data.IsCompressed( );
+    line.flipMask = jointFlipMask;
+}
+
+/* TLC cells (3 flag bits each) whose state differs between two flip masks. */
+uint64_t FRFCFS::FlagCellChanges( uint64_t mask, uint64_t oldMask )
+{
+    uint64_t changes = 0;
+
+    for( uint64_t i = 0; i < 64; i += 3 )
+    {
+        if( ((mask ^ oldMask) >> i) & 0x7 )
+            changes++;
+    }
+
+    return changes;
+}
+
+void FRFCFS::FlipPayload( uint8_t *bytes, uint64_t partition, uint64_t bits )
+{
+    uint64_t start = partition * jointFlipGranularity;
+    uint64_t end = MIN( start + jointFlipGranularity, bits );
+
+    for( uint64_t bit = start; bit < end; bit++ )
+        bytes[bit / 8] = static_cast<uint8_t>( bytes[bit / 8] ^ (1 << (bit % 8)) );
+}
+
+void FRFCFS::CalculateStats( )
+{
+    /* Mean convergence of the dictionaries' pattern selections. */
+    if( dictionaries != NULL )
+    {
+        dfpc_confidence = 0.0f;
+        for( uint64_t i = 0; i < dictionaryCount; i++ )
+            dfpc_confidence += Confidence( dictionaries[i] );
+        dfpc_confidence /= static_cast<double>(dictionaryCount);
+
+        std::stringstream table;
+
+        table << "{";
+        for( uint64_t i = 0; i < dictionaryCount; i++ )
+        {
+            const DFPCPatternSet& patterns = dictionaries[i].activePatterns;
+
+            table << (i ? ", " : "") << i << ": {'generation': " << patterns.generation 
+                  << ", 'masks': [" << std::hex;
+            for( int j = 0; j < patterns.mask_pos; j++ )
+                table << (j ? ", " : "") << "'0x" << patterns.masks[j] << "'";
+            table << std::dec << "], 'special': [";
+            for( int j = 0, listed = 0; j < 1 + BDICOUNT; j++ )
+            {
+                if( patterns.special_pattern_flag[j] )
+                    table << (listed++ ? ", " : "") << j;
+            }
+            table << "]}";
+        }
+        table << "}";
+
+        dfpcPatternTable = table.str( );
+    }
+
+    roundtripFailureHisto = PyDictHistogram<uint64_t, uint64_t>( roundtripFailureMap );
+    writePauseLatencyPercentiles = writePauseLatency.PercentileDict( latencyPercentiles );
+
+    if( compressed_bytes > 0 )
+        aggregate_compress_ratio = static_cast<double>(uncompressed_bytes) 
+                                 / static_cast<double>(compressed_bytes);
+
+    std::stringstream hits;
+    bool firstHit = true;
+
+    hits << "{";
+    for( uint64_t i = 0; i < SCHEME_COUNT; i++ )
+    {
+        for( uint64_t j = 0; j < PATTERN_SLOTS; j++ )
+        {
+            if( patternHits[i][j] == 0 )
+                continue;
+
+            hits << (firstHit ? "" : ", ") << "'" << PatternName( i, j ) << "': " << patternHits[i][j];
+            firstHit = false;
+        }
+    }
+    hits << "}";
+    patternHitsHisto = hits.str( );
+
+    fpcSizeHisto = PyDictHistogram<uint64_t, uint64_t>( compressedSizeMap[SCHEME_FPC] );
+    bdiSizeHisto = PyDictHistogram<uint64_t, uint64_t>( compressedSizeMap[SCHEME_BDI] );
+    dfpcStaticSizeHisto = PyDictHistogram<uint64_t, uint64_t>( compressedSizeMap[SCHEME_DFPC_STATIC] );
+    dfpcDynamicSizeHisto = PyDictHistogram<uint64_t, uint64_t>( compressedSizeMap[SCHEME_DFPC_DYNAMIC] );
+
+    /* Lines stored per column slot actually in use. */
+    packed_lines = lineTable.size( );
+    packed_slots = slotLines.size( );
+    if( packed_slots > 0 )
+        effective_capacity = static_cast<double>(packed_lines) / static_cast<double>(packed_slots);
+
+    MemoryController::CalculateStats( );
+}
+
+
+
+//EDFPCscheme
+
+uint64_t FRFCFS::my_llabs ( int64_t x )
+{
+    uint64_t t = x >> 63;
+    return (x ^ t) - t;
+}
+
+uint64_t FRFCFS::my_abs ( int x )
+{
+    uint64_t t = x >> 31;
+    return (x ^ t) - t;
+}
+
+uint64_t * FRFCFS::convertByte2Word (NVMainRequest *request, bool flag, uint64_t size, uint64_t step)//flag: false-olddata true-newdata
+{
+    uint64_t * values = (uint64_t *) malloc(sizeof(uint64_t) * size/step);
+    uint64_t i,j; 
+    for (i = 0; i < size / step; i++) {
+        values[i] = 0;    // Initialize all elements to zero.
+    }
+    
+    for (i = 0; i < size; i += step ){
+        for (j = 0; j < step; j++){
+            if(flag)
+                values[i / step] += (uint64_t)request->data.GetByte(i + j) << (8*j);
+            else
+                values[i / step] += (uint64_t)request->oldData.GetByte(i + j) << (8*j);
+                
+        }
+    }
+    return values;
+}
+
+uint64_t FRFCFS::GetChanges (NVMainRequest *request, uint32_t MLCLevels, bool DCWFlag)
+{
+    uint32_t *rawData = NULL;
+    uint32_t *oldData = NULL;
+    uint64_t memoryWordSize = 64*8;
+    if(request->data.IsCompressed())
+    {
+        rawData = reinterpret_cast<uint32_t*>(request->data.comData);
+        memoryWordSize = request->data.GetComSize()*8;
+    }
+    else
+    {
+        rawData = reinterpret_cast<uint32_t*>(request->data.rawData);
+    }
+    
+    if(request->oldData.IsCompressed())
     {
         oldData = reinterpret_cast<uint32_t*>(request->oldData.comData);
     }
@@ -466,6 +1955,19 @@ uint64_t FRFCFS::GetChanges (NVMainRequest *request, uint32_t MLCLevels, bool DC
     }
     if(!DCWFlag)
         return memoryWordSize;
+    
+    return CellChanges(rawData, oldData, memoryWordSize, MLCLevels);
+}
+
+/*
+ *  Bits written when memoryWordSize bits of rawData replace oldData in cells
+ *  of MLCLevels bits; the last, partial cell of each word counts 2 bits.
+ */
+uint64_t FRFCFS::CellChanges (uint32_t *rawData, uint32_t *oldData, uint64_t memoryWordSize, uint32_t MLCLevels)
+{
+    uint64_t size = 0;
+    uint64_t bitsChange = 0;
+    uint64_t cellsChange = 0;
     size = memoryWordSize/32;
     
     if(size > 16)
@@ -680,11 +2182,13 @@ bool FRFCFS::GeneralCompress (NVMainRequest *request, uint64_t compress)
             break;
         case 1:	
             //FPC
+            lastScheme = SCHEME_FPC;
             resFlag = FPCCompress(request, _blockSize/4, true);
             FPCCompress(request, _blockSize/4, false);
             break;
         case 2:
             //BDI
+            lastScheme = SCHEME_BDI;
 			resFlag = BDICompress(request, _blockSize, true);
             BDICompress(request, _blockSize, false);
             break;
@@ -698,6 +2202,50 @@ bool FRFCFS::GeneralCompress (NVMainRequest *request, uint64_t compress)
     return resFlag;
 }
 
+/*
+ *  Pattern hits are held for the current write until it is known whether
+ *  the line is stored compressed (the joint encoder may store it raw).
+ */
+void FRFCFS::CountPatterns( CompressionScheme scheme, const uint8_t *pattern, uint64_t count )
+{
+    pendingScheme = scheme;
+    for( uint64_t i = 0; i < count; i++ )
+        pendingPatterns[pattern[i]]++;
+}
+
+void FRFCFS::CommitPatterns( bool stored )
+{
+    for( uint64_t i = 0; i < PATTERN_SLOTS; i++ )
+    {
+        if( stored )
+            patternHits[pendingScheme][i] += pendingPatterns[i];
+        pendingPatterns[i] = 0;
+    }
+}
+
+/* Stat names of the pattern slots, e.g. fpc.011, bdi.b8d2 or dfpc.mask3. */
+std::string FRFCFS::PatternName( uint64_t scheme, uint64_t slot )
+{
+    static const char *schemeNames[SCHEME_COUNT] = { "none", "fpc", "bdi", "dfpc_static", "dfpc" };
+    static const char *bdiNames[BDICOUNT] = { "b8rep", "b8d1", "b8d2", "b8d4", "b4rep", "b4d1", "b4d2", "b2d1" };
+    std::stringstream name;
+
+    name << schemeNames[scheme] << ".";
+
+    if( scheme == SCHEME_BDI )
+        name << bdiNames[slot % BDICOUNT];
+    else if( slot >= PATTERN_BDI )
+        name << bdiNames[slot - PATTERN_BDI];
+    else if( slot >= PATTERN_MASK )
+        name << "mask" << slot - PATTERN_MASK;
+    else if( slot == 0 && scheme != SCHEME_FPC )
+        name << "zeroline";
+    else
+        name << ((slot >> 2) & 1) << ((slot >> 1) & 1) << (slot & 1);
+
+    return name.str( );
+}
+
 bool FRFCFS::Word2Byte (NVMainRequest *request, bool flag, uint64_t size, uint64_t comSize, uint64_t *words, uint64_t *wordPos)//flag: false-olddata true-newdata
 {
     uint64_t i,j;
@@ -709,6 +2257,14 @@ bool FRFCFS::Word2Byte (NVMainRequest *request, bool flag, uint64_t size, uint64
     if(flag)//compressible newdata
     {
         request->data.SetComSize(comSize);
+        
+        /* Codeword lengths for the verify-mode decompressor. */
+        if(verifyCompression)
+        {
+            writeImage.count = size;
+            for(i = 0; i < size && i < 35; i++)
+                writeImage.lengths[i] = static_cast<uint8_t>(wordPos[i]);
+        }
     }
     else
     {
@@ -772,6 +2328,7 @@ bool FRFCFS::FPCCompress(NVMainRequest *request, uint64_t size, bool flag ){
     uint64_t i;
     uint64_t words[16];
     uint64_t wordPos[16]; //0~8 chars
+    uint8_t pattern[16];  //3-bit prefix
     uint64_t comSize = 0;
     bool comFlag = false;
     
@@ -780,6 +2337,7 @@ bool FRFCFS::FPCCompress(NVMainRequest *request, uint64_t size, bool flag ){
         // 000
         if(values[i] == 0){
             words[i] = values[i] + 0x0;
+            pattern[i] = 0;
             wordPos[i] = 1;
             comSize += wordPos[i];
             continue;
@@ -787,6 +2345,7 @@ bool FRFCFS::FPCCompress(NVMainRequest *request, uint64_t size, bool flag ){
         // 001
         if(my_abs((int)(values[i])) <= 0xFF){
             words[i] = my_abs((int)(values[i])) + 0x100;
+            pattern[i] = 1;
             wordPos[i] = 3;
             comSize += wordPos[i];
             continue;
@@ -794,6 +2353,7 @@ bool FRFCFS::FPCCompress(NVMainRequest *request, uint64_t size, bool flag ){
         // 011
         if(my_abs((int)(values[i])) <= 0xFFFF){
             words[i] = my_abs((int)(values[i])) + 0x30000;
+            pattern[i] = 3;
             wordPos[i] = 5;
             comSize += wordPos[i];
             continue;
@@ -801,6 +2361,7 @@ bool FRFCFS::FPCCompress(NVMainRequest *request, uint64_t size, bool flag ){
         //100  
         if(((values[i]) & 0xFFFF) == 0 ){
             words[i] = (values[i] >> 16) + 0x40000;
+            pattern[i] = 4;
             wordPos[i] = 5;
             comSize += wordPos[i];
             continue;
@@ -809,6 +2370,7 @@ bool FRFCFS::FPCCompress(NVMainRequest *request, uint64_t size, bool flag ){
         if( my_abs((int)((values[i]) & 0xFFFF)) <= 0xFF
              && my_abs((int)((values[i] >> 16) & 0xFFFF)) <= 0xFF){
             words[i] = my_abs((int)((values[i] >> 8))) + my_abs((int)((values[i]) & 0xFFFF)) + 0x50000;
+            pattern[i] = 5;
             wordPos[i] = 5;
             comSize += wordPos[i];
             continue;
@@ -820,12 +2382,14 @@ bool FRFCFS::FPCCompress(NVMainRequest *request, uint64_t size, bool flag ){
         uint64_t byte3 = (values[i] >> 24) & 0xFF;
         if(byte0 == byte1 && byte0 == byte2 && byte0 == byte3){
             words[i] = byte0 + 0x600;
+            pattern[i] = 6;
             wordPos[i] = 3;
             comSize += wordPos[i];
             continue;
         }
         //111
         words[i] = values[i];
+        pattern[i] = 7;
         wordPos[i] = 8;
         comSize += wordPos[i];
     }
@@ -842,7 +2406,11 @@ bool FRFCFS::FPCCompress(NVMainRequest *request, uint64_t size, bool flag ){
     values = NULL;
     
     if(comFlag)
+    {
         Word2Byte(request, flag, size, comSize, words, wordPos);
+        if(flag)
+            CountPatterns(SCHEME_FPC, pattern, size);
+    }
     
     
     
@@ -1081,6 +2649,11 @@ bool FRFCFS::BDICompress (NVMainRequest *request, uint64_t _blockSize, bool flag
     {
         comFlag = true;
         Word2Byte(request, flag, bestPos, bestCSize, words, wordPos);
+        if(flag)
+        {
+            uint8_t variant = static_cast<uint8_t>(words[0]);
+            CountPatterns(SCHEME_BDI, &variant, 1);
+        }
     }
     
     return comFlag;
@@ -1089,33 +2662,148 @@ bool FRFCFS::BDICompress (NVMainRequest *request, uint64_t _blockSize, bool flag
 
 bool FRFCFS::DFPCCompress(NVMainRequest *request, uint64_t _blockSize )
 {
-    if(mem_writes < granularities)
+    uint64_t dictionaryId = DictionaryFor(request);
+    DFPCDictionary& dict = dictionaries[dictionaryId];
+    
+    request->data.SetDictionary(dictionaryId);
+    request->oldData.SetDictionary(dictionaryId);
+    
+    if(dfpcWrites < granularities && !dict.converged)
 	{
-        FPCIdentify(request, _blockSize / 4);
-        BDIIdentify(request, _blockSize);
-        Sample(request, _blockSize);
+        lastScheme = SCHEME_DFPC_STATIC;
+        if(dfpcEpoch > 0)
+            lineGeneration.erase(request->address.GetPhysicalAddress( ));
+        if(SampleWrite(dict))
+            return WarmupCompress(request, _blockSize, dict);
         StaticCompress(request, _blockSize/4, false);
 		return StaticCompress(request, _blockSize/4, true);
 	}else
 	{
-        if(sample_flag)
-            ExtractPattern();
-        DynamicCompress(request, _blockSize, false);
-		return DynamicCompress(request, _blockSize, true);
+        lastScheme = SCHEME_DFPC_DYNAMIC;
+        if(dict.sample_flag)
+            ExtractPattern(dict);
+        else if(dfpcEpoch > 0)
+            RelearnPatterns(request, _blockSize, dict);
+        DynamicCompress(request, _blockSize, false, OldDataPatterns(request, dict));
+		return DynamicCompress(request, _blockSize, true, &dict.activePatterns);
 	}
 }
 
-bool FRFCFS::DynamicCompress(NVMainRequest *request, uint64_t size, bool flag  )
+uint64_t FRFCFS::DictionaryFor(NVMainRequest *request)
+{
+    uint64_t rank, bank;
+    
+    if(dictionaryScope == DICTIONARY_BANK)
+    {
+        request->address.GetTranslatedAddress( NULL, NULL, &bank, &rank, NULL, NULL );
+        return rank * p->BANKS + bank;
+    }
+    else if(dictionaryScope == DICTIONARY_REGION)
+    {
+        return (request->address.GetPhysicalAddress( ) / dictionaryRegionSize) % dictionaryCount;
+    }
+    
+    return 0;
+}
+
+/*
+ *  Keep sampling after warm-up and extract a fresh pattern set every
+ *  dfpcEpoch writes so the dictionary follows program phases.
+ */
+void FRFCFS::RelearnPatterns(NVMainRequest *request, uint64_t _blockSize, DFPCDictionary& dict)
+{
+    uint64_t words8[DFPCLINESIZE/8];
+    uint64_t words4[DFPCLINESIZE/4];
+    uint64_t words2[DFPCLINESIZE/2];
+    
+    if(SampleWrite(dict))
+    {
+        DecodeLine(request, true, words8, words4, words2);
+        FPCIdentify(words4, _blockSize / 4, dict);
+        BDIIdentify(words8, words4, words2, _blockSize, dict);
+        Sample(words4, dict);
+    }
+    
+    if(++dict.epochWrites >= dfpcEpoch)
+    {
+        ExtractPattern(dict);
+        dict.epochWrites = 0;
+        dfpc_relearns++;
+    }
+}
+
+/*
+ *  The old contents of a line are encoded with the dictionary that was active
+ *  when it was last written. Lines from the warm-up used the static scheme;
+ *  lines from an earlier epoch are decoded with that epoch's retired set and
+ *  recompressed with the active one by this write. Lines older than the
+ *  DFPCHISTORY retired sets are approximated with the static scheme.
+ */
+const FRFCFS::DFPCPatternSet *FRFCFS::OldDataPatterns(NVMainRequest *request, DFPCDictionary& dict)
+{
+    if(dfpcEpoch == 0)
+        return &dict.activePatterns;
+    
+    uint64_t& generation = lineGeneration[request->address.GetPhysicalAddress( )];
+    const DFPCPatternSet *patterns = &dict.activePatterns;
+    
+    if(generation == 0)
+    {
+        patterns = NULL;
+    }
+    else if(generation != dict.activePatterns.generation)
+    {
+        const DFPCPatternSet& retired = dict.retiredPatterns[generation % DFPCHISTORY];
+        patterns = (retired.generation == generation) ? &retired : NULL;
+    }
+    
+    if(generation != dict.activePatterns.generation)
+        dfpc_stale_lines++;
+    
+    generation = dict.activePatterns.generation;
+    
+    return patterns;
+}
+
+bool FRFCFS::DynamicCompress(NVMainRequest *request, uint64_t size, bool flag, const DFPCPatternSet *patterns )
 {
     
     uint64_t FPC_pattern_size=0, BDI_pattern_size=0;
     
-    FPC_pattern_size = DynamicFPCCompress(request, size/4, flag);
-    BDI_pattern_size = DynamicBDICompress(request, size, flag);
-    if(FPC_pattern_size < BDI_pattern_size)
+    /* No dictionary: the line is still in the warm-up (static) format. */
+    if(patterns == NULL)
+        return StaticCompress(request, size/4, flag);
+    
+    uint64_t words8[DFPCLINESIZE/8];
+    uint64_t words4[DFPCLINESIZE/4];
+    uint64_t words2[DFPCLINESIZE/2];
+    DFPCEncoding fpc, bdi;
+    
+    /* Both candidates encode into scratch space; only the smaller one is written back. */
+    DecodeLine(request, flag, words8, words4, words2);
+    FPC_pattern_size = DynamicFPCCompress(words8, words4, size/4, *patterns, fpc);
+    BDI_pattern_size = DynamicBDICompress(words8, words4, words2, size, *patterns, bdi);
+    if(fpc.compressed && FPC_pattern_size < BDI_pattern_size)
+    {
+        Word2Byte(request, flag, fpc.count, fpc.comSize, fpc.words, fpc.wordPos);
+        if(flag)
+        {
+            writeImage.format = IMAGE_FPC;
+            CountPatterns(SCHEME_DFPC_DYNAMIC, fpc.pattern, fpc.count);
+        }
+    }
+    else if(bdi.compressed)
     {
-        DynamicFPCCompress(request, size/4, flag);
+        Word2Byte(request, flag, bdi.count, bdi.comSize, bdi.words, bdi.wordPos);
+        if(flag)
+        {
+            uint8_t variant = static_cast<uint8_t>(PATTERN_BDI + bdi.variant);
+            writeImage.format = static_cast<uint8_t>(bdi.variant);
+            CountPatterns(SCHEME_DFPC_DYNAMIC, &variant, 1);
+        }
     }
+    if(flag && verifyCompression)
+        writeImage.patterns = *patterns;
     if(flag)
         return request->data.IsCompressed();
     else
@@ -1123,48 +2811,48 @@ bool FRFCFS::DynamicCompress(NVMainRequest *request, uint64_t size, bool flag  )
     
 }
 
-uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool flag )
+uint64_t FRFCFS::DynamicFPCCompress(uint64_t *words8, uint64_t *values, uint64_t size, const DFPCPatternSet& patterns, DFPCEncoding& enc )
 {
-    uint64_t * values = convertByte2Word(request, flag, size*4, 8);
     uint64_t i, j, k;
     
-    uint64_t words[16];
-    uint64_t wordPos[16]; //0~8 chars
+    uint64_t *words = enc.words;
+    uint64_t *wordPos = enc.wordPos; //0~8 chars
+    uint8_t *pattern = enc.pattern;
     uint64_t comSize = 0;
     bool comFlag = false;
     bool dynamicFlag = false;
     
-    if( isZeroPackable( values, size*4 / 8))
+    if( isZeroPackable( words8, size*4 / 8))
     {
         // 000
         words[0] = 0;
         wordPos[0] = 1;
+        pattern[0] = 0;
         comFlag = true;
         comSize = 1;
-        free(values);
-        values = NULL;
-        Word2Byte(request, flag, comSize, comSize, words, wordPos);
+        enc.count = 1;
+        enc.comSize = comSize;
+        enc.compressed = comFlag;
         return comSize;
     }
-    free(values);
     
-    values = convertByte2Word(request, flag, size*4, 4);
     for (i = 0; i < size; i++) {
         // 001
         if(values[i] == 0){
             words[i] = values[i] + 0x1;
+            pattern[i] = 1;
             wordPos[i] = 1;
             comSize += wordPos[i];
             continue;
         }
         dynamicFlag = true;
-        for(j = 0; j < mask_pos && dynamicFlag; j++)
+        for(j = 0; j < patterns.mask_pos && dynamicFlag; j++)
         {
-            int compressible_char = 8 - compressibleChars[j];
-            if(compressible_char < 4 && ((my_abs((int)(values[i])) & masks[j]) == 0))
+            int compressible_char = 8 - patterns.compressibleChars[j];
+            if(compressible_char < 4 && ((my_abs((int)(values[i])) & patterns.masks[j]) == 0))
             {
                 words[i] = ((j+4)<<(compressible_char*4));
-                uint64_t mask = masks[j];
+                uint64_t mask = patterns.masks[j];
                 uint64_t word = my_abs((int)(values[i]));
                 for(k = 0; k < compressible_char; k++)
                 {
@@ -1178,6 +2866,7 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
                 //words[i] = my_abs((int)(values[i])) + ((j+4)<<(compressible_char*4));
 
                 wordPos[i] = 1 + compressible_char;
+                pattern[i] = static_cast<uint8_t>(PATTERN_MASK + j);
                 comSize += wordPos[i];
                 dynamicFlag = false;
                 break;
@@ -1188,6 +2877,7 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
         // 011
         if(my_abs((int)(values[i])) <= 0xFFFF){
             words[i] = my_abs((int)(values[i])) + 0x30000;
+            pattern[i] = 3;
             wordPos[i] = 5;
             comSize += wordPos[i];
             continue;
@@ -1195,18 +2885,19 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
         //100  
         if(((values[i]) & 0xFFFF) == 0 ){
             words[i] = (values[i] >> 16) + 0x40000;
+            pattern[i] = 4;
             wordPos[i] = 5;
             comSize += wordPos[i];
             continue;
         }
-        for(j = 0; j < mask_pos && dynamicFlag; j++)
+        for(j = 0; j < patterns.mask_pos && dynamicFlag; j++)
         {
-            int compressible_char = 8 - compressibleChars[j];
-            if(compressible_char >= 4 && ((my_abs((int)(values[i])) & masks[j]) == 0))
+            int compressible_char = 8 - patterns.compressibleChars[j];
+            if(compressible_char >= 4 && ((my_abs((int)(values[i])) & patterns.masks[j]) == 0))
             {
                 
                 words[i] = ((j+4)<<(compressible_char*4));
-                uint64_t mask = masks[j];
+                uint64_t mask = patterns.masks[j];
                 uint64_t word = my_abs((int)(values[i]));
                 for(k = 0; k < compressible_char; k++)
                 {
@@ -1219,6 +2910,7 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
                 }
                 //words[i] = my_abs((int)(values[i])) + ((j+4)<<(compressible_char*4));
                 wordPos[i] = 1 + compressible_char;
+                pattern[i] = static_cast<uint8_t>(PATTERN_MASK + j);
                 comSize += wordPos[i];
                 dynamicFlag = false;
                 break;
@@ -1228,7 +2920,7 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
             continue;
         
         //110
-        if(special_pattern_flag[0])
+        if(patterns.special_pattern_flag[0])
         {
             uint64_t byte0 = (values[i]) & 0xFF;
             uint64_t byte1 = (values[i] >> 8) & 0xFF;
@@ -1236,6 +2928,7 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
             uint64_t byte3 = (values[i] >> 24) & 0xFF;
             if(byte0 == byte1 && byte0 == byte2 && byte0 == byte3){
                 words[i] = byte0 + 0x600;
+                pattern[i] = 6;
             wordPos[i] = 3;
             comSize += wordPos[i];
                 continue;
@@ -1243,6 +2936,7 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
         }
         words[i] = values[i];
         wordPos[i] = 8;
+        pattern[i] = 7;
         comSize += wordPos[i];
     }
     if(comSize % 2 == 1)
@@ -1252,14 +2946,9 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
     {
         comFlag = true;
     }
-    free(values);
-    values = NULL;
-    if(comFlag)
-    {
-        Word2Byte(request, flag, size, comSize, words, wordPos);
-        if(flag)
-            comSize = request->data.GetComSize();
-    }
+    enc.count = size;
+    enc.comSize = comSize;
+    enc.compressed = comFlag;
     
     
     //6 bytes for 3 bit per every 4-byte word in a 64 byte cache line
@@ -1267,19 +2956,20 @@ uint64_t FRFCFS::DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool
     return comSize;
 }
 
-uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize, bool flag )
+uint64_t FRFCFS::DynamicBDICompress(uint64_t *words8, uint64_t *words4, uint64_t *words2, uint64_t _blockSize, const DFPCPatternSet& patterns, DFPCEncoding& enc )
 {
-    uint64_t * values = convertByte2Word(request, flag, _blockSize, 8);
+    uint64_t * values = words8;
     uint64_t bestCSize = _blockSize;
     uint64_t currCSize = _blockSize;
     uint64_t i, pos, bestPos;
-    uint64_t words[34];
-    uint64_t wordPos[34]; //0~8 chars
+    uint64_t *words = enc.words;
+    uint64_t *wordPos = enc.wordPos; //0~8 chars
     
     uint64_t currWords[34];
     uint64_t currWordPos[34]; //0~8 chars
     bestPos = 0;
-    if(special_pattern_flag[1] || special_pattern_flag[2] || special_pattern_flag[3] || special_pattern_flag[4])
+    enc.variant = 0;
+    if(patterns.special_pattern_flag[1] || patterns.special_pattern_flag[2] || patterns.special_pattern_flag[3] || patterns.special_pattern_flag[4])
     {
         if( isSameValuePackable( values, _blockSize / 8))
         {
@@ -1288,6 +2978,7 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
         if(bestCSize > currCSize)
         {
             bestCSize = currCSize;
+            enc.variant = 0;
             bestPos = bestCSize / 4;
             for(i = 0; i < bestPos; i++)
             {
@@ -1299,6 +2990,7 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
         if(bestCSize > currCSize)
         {
             bestCSize = currCSize;
+            enc.variant = 1;
             bestPos = pos;
             for(i = 0; i < bestPos; i++)
             {
@@ -1310,6 +3002,7 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
         if(bestCSize > currCSize)
         {
             bestCSize = currCSize;
+            enc.variant = 2;
             bestPos = pos;
             for(i = 0; i < bestPos; i++)
             {
@@ -1321,6 +3014,7 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
         if(bestCSize > currCSize)
         {
             bestCSize = currCSize;
+            enc.variant = 3;
             bestPos = pos;
             for(i = 0; i < bestPos; i++)
             {
@@ -1329,10 +3023,9 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
             }
         }
     }
-    if(special_pattern_flag[5] || special_pattern_flag[6] || special_pattern_flag[7])
+    if(patterns.special_pattern_flag[5] || patterns.special_pattern_flag[6] || patterns.special_pattern_flag[7])
     {
-        free(values);
-        values = convertByte2Word(request, flag, _blockSize, 4);
+        values = words4;
         if( isSameValuePackable( values, _blockSize / 4))
         {
             currCSize = 4;
@@ -1340,6 +3033,7 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
         if(bestCSize > currCSize)
         {
             bestCSize = currCSize;
+            enc.variant = 4;
             bestPos = bestCSize / 4;
             for(i = 0; i < bestPos; i++)
             {
@@ -1352,6 +3046,7 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
         if(bestCSize > currCSize)
         {
             bestCSize = currCSize;
+            enc.variant = 5;
             bestPos = pos;
             for(i = 0; i < bestPos; i++)
             {
@@ -1363,6 +3058,7 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
         if(bestCSize > currCSize)
         {
             bestCSize = currCSize;
+            enc.variant = 6;
             bestPos = pos;
             for(i = 0; i < bestPos; i++)
             {
@@ -1371,14 +3067,14 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
             }
         }
     }
-    if(special_pattern_flag[8])
+    if(patterns.special_pattern_flag[8])
     {
-        free(values);
-        values = convertByte2Word(request, flag, _blockSize, 2);
+        values = words2;
         currCSize = multBaseCompression( values, _blockSize / 2, 1, 2, currWords, currWordPos, pos);
         if(bestCSize > currCSize)
         {
             bestCSize = currCSize;
+            enc.variant = 7;
             bestPos = pos;
             for(i = 0; i < bestPos; i++)
             {
@@ -1387,96 +3083,444 @@ uint64_t FRFCFS::DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize,
             }
         }
     }
-    free(values);
-    values = NULL;
-    if(bestCSize < _blockSize)
+    enc.count = bestPos;
+    enc.compressed = (bestCSize < _blockSize);
+    if(enc.compressed)
     {
-        Word2Byte(request, flag, bestPos, bestCSize, words, wordPos);
+        /* Compare by the packed nibble size, which is what Word2Byte stores. */
+        uint64_t nibbles = 0;
+        for(i = 0; i < bestPos; i++)
+            nibbles += wordPos[i];
+        bestCSize = (nibbles + 1) / 2;
+    }
+    enc.comSize = bestCSize;
+    
+    return bestCSize;
+}
+
+bool FRFCFS::StaticCompress(NVMainRequest *request, uint64_t size, bool flag )
+{
+    uint64_t words8[DFPCLINESIZE/8];
+    uint64_t words4[DFPCLINESIZE/4];
+    uint64_t words2[DFPCLINESIZE/2];
+    
+    DecodeLine(request, flag, words8, words4, words2);
+    return StaticEncode(request, flag, size, words8, words4);
+}
+
+bool FRFCFS::StaticEncode(NVMainRequest *request, bool flag, uint64_t size, uint64_t *words8, uint64_t *values )
+{
+    uint64_t i;
+    
+    uint64_t words[16];
+    uint64_t wordPos[16]; //0~8 chars
+    uint8_t pattern[16];  //3-bit prefix
+    uint64_t comSize = 0;
+    bool comFlag = false;
+    
+    if( isZeroPackable( words8, size*4 / 8))
+    {
+        // 000
+        words[0] = 0;
+        wordPos[0] = 1;
+        comFlag = true;
+        comSize = 1;
+        Word2Byte(request, flag, comSize, comSize, words, wordPos);
+        if(flag)
+        {
+            pattern[0] = 0;
+            CountPatterns(SCHEME_DFPC_STATIC, pattern, 1);
+        }
+        return comFlag;
+    }
+    for (i = 0; i < size; i++) {
+     
+        // 001
+        if(values[i] == 0){
+            words[i] = values[i] + 0x1;
+            pattern[i] = 1;
+            wordPos[i] = 1;
+            comSize += wordPos[i];
+            continue;
+        }
+        // 010
+        if(my_abs((int)(values[i])) <= 0xFFFF){
+            words[i] = my_abs((int)(values[i])) + 0x20000;
+            pattern[i] = 2;
+            wordPos[i] = 5;
+            comSize += wordPos[i];
+            continue;
+        }
+        //011  
+        if(((values[i]) & 0xFFFF) == 0 ){
+            words[i] = (values[i] >> 16) + 0x30000;
+            pattern[i] = 3;
+            wordPos[i] = 5;
+            comSize += wordPos[i];
+            continue;
+        }
+        //uncompressible
+        words[i] = values[i];
+        pattern[i] = 7;
+        wordPos[i] = 8;
+        comSize += wordPos[i];
+    }
+    if(comSize % 2 == 1)
+        comSize++;
+    comSize /= 2;
+    if(comSize < (size*4))
+    {
+        comFlag = true;
+    }
+    if(comFlag)
+    {
+        Word2Byte(request, flag, size, comSize, words, wordPos);
         if(flag)
-            bestCSize = request->data.GetComSize();
-        /*else
-            bestCSize = request->oldData.GetComSize();*/
+            CountPatterns(SCHEME_DFPC_STATIC, pattern, size);
+    }
+    return comFlag;
+}
+
+/*
+ *  Decode a line once into its 8-, 4- and 2-byte little endian words so the
+ *  identification and static compression passes share one read of the data.
+ */
+void FRFCFS::DecodeLine(NVMainRequest *request, bool flag, uint64_t *words8, uint64_t *words4, uint64_t *words2)
+{
+    NVMDataBlock& block = flag ? request->data : request->oldData;
+    uint64_t i, j;
+    
+    for(i = 0; i < DFPCLINESIZE/8; i++)
+    {
+        uint64_t value = 0;
+        
+        for(j = 0; j < 8; j++)
+            value |= static_cast<uint64_t>(block.GetByte(8*i + j)) << (8*j);
+        
+        words8[i] = value;
+        for(j = 0; j < 2; j++)
+            words4[2*i + j] = (value >> (32*j)) & 0xFFFFFFFF;
+        for(j = 0; j < 4; j++)
+            words2[4*i + j] = (value >> (16*j)) & 0xFFFF;
     }
+}
+
+/*
+ *  Warm-up path: one decode of each line feeds the FPC/BDI/sample counters
+ *  and the static compression of both the old and the new data.
+ */
+bool FRFCFS::WarmupCompress(NVMainRequest *request, uint64_t _blockSize, DFPCDictionary& dict)
+{
+    uint64_t words8[DFPCLINESIZE/8];
+    uint64_t words4[DFPCLINESIZE/4];
+    uint64_t words2[DFPCLINESIZE/2];
     
+    DecodeLine(request, false, words8, words4, words2);
+    StaticEncode(request, false, _blockSize/4, words8, words4);
     
-    return bestCSize;
+    DecodeLine(request, true, words8, words4, words2);
+    FPCIdentify(words4, _blockSize/4, dict);
+    BDIIdentify(words8, words4, words2, _blockSize, dict);
+    Sample(words4, dict);
+    
+    if(++dict.samples % dfpcCheckInterval == 0)
+        CheckConvergence(dict);
+    
+    return StaticEncode(request, true, _blockSize/4, words8, words4);
+}
+
+/*
+ *  Decompressors for the verify mode. The nibble stream written by Word2Byte
+ *  is split back into codewords using the stored codeword lengths, and each
+ *  codeword is decoded by its length and prefix nibble.
+ */
+bool FRFCFS::DecompressImage( const CompressedImage& image, uint8_t *line )
+{
+    uint64_t words[35];
+    uint64_t values[DFPCLINESIZE/4];
+    uint64_t i, j, nibble = 0;
+    bool ok = false;
+    
+    if(image.count == 0 || image.count > 35)
+        return false;
+    
+    for(i = 0; i < image.count; i++)
+    {
+        words[i] = 0;
+        for(j = 0; j < image.lengths[i]; j++, nibble++)
+        {
+            if(nibble >= 2 * image.comSize)
+                return false;
+            
+            uint8_t dataByte = image.bytes[nibble / 2];
+            words[i] = (words[i] << 4) | ((nibble % 2) ? (dataByte & 0xF) : (dataByte >> 4));
+        }
+    }
+    
+    for(i = 0; i < DFPCLINESIZE/4; i++)
+        values[i] = 0;
+    
+    switch(image.scheme)
+    {
+        case SCHEME_FPC:
+            ok = FPCDecompress(words, image.lengths, image.count, values);
+            break;
+        case SCHEME_BDI:
+            /* The first codeword selects the base/delta variant. */
+            return BDIDecompress(words[0], words + 1, image.lengths + 1, image.count - 1, line);
+        case SCHEME_DFPC_STATIC:
+            ok = StaticDecompress(words, image.lengths, image.count, values);
+            break;
+        case SCHEME_DFPC_DYNAMIC:
+            if(image.format != IMAGE_FPC)
+                return BDIDecompress(image.format, words, image.lengths, image.count, line);
+            ok = DynamicFPCDecompress(words, image.lengths, image.count, image.patterns, values);
+            break;
+        default:
+            break;
+    }
+    
+    for(i = 0; i < DFPCLINESIZE; i++)
+        line[i] = static_cast<uint8_t>(values[i/4] >> (8 * (i%4)));
+    
+    return ok;
+}
+
+/* Inverse of Encoder: every 3-bit cell 000, 001, 110 or 111 holds 2 data bits. */
+bool FRFCFS::DecodeCells( const CompressedImage& image, uint8_t *bytes )
+{
+    uint64_t bits = image.comSize * 8 - (image.half ? 4 : 0);
+    uint64_t cells = bits / 2;
+    uint64_t i, j;
+    
+    if(image.comSize > DFPCLINESIZE || cells * 3 > image.encodedSize * 8)
+        return false;
+    
+    for(i = 0; i < DFPCLINESIZE; i++)
+        bytes[i] = 0;
+    
+    for(i = 0; i < cells; i++)
+    {
+        uint64_t cell = 0;
+        uint8_t value;
+        
+        for(j = 0; j < 3; j++)
+        {
+            uint64_t bit = 3*i + j;
+            cell = (cell << 1) | ((image.encodedBytes[bit/8] >> (7 - bit%8)) & 0x1);
+        }
+        switch(cell)
+        {
+            case 0: value = 0; break;
+            case 1: value = 1; break;
+            case 6: value = 2; break;
+            case 7: value = 3; break;
+            default: return false;
+        }
+        bytes[(2*i)/8] |= static_cast<uint8_t>(value << (6 - (2*i)%8));
+    }
+    return true;
+}
+
+bool FRFCFS::FPCDecompress( uint64_t *words, const uint8_t *lengths, uint64_t count, uint64_t *values )
+{
+    uint64_t i, payload;
+    
+    if(count != DFPCLINESIZE/4)
+        return false;
+    
+    for(i = 0; i < count; i++)
+    {
+        switch(lengths[i])
+        {
+            case 1:
+                // 000
+                values[i] = 0;
+                break;
+            case 3:
+                payload = words[i] & 0xFF;
+                if((words[i] >> 8) == 0x1)          // 001
+                    values[i] = payload;
+                else if((words[i] >> 8) == 0x6)     // 110
+                    values[i] = payload * 0x01010101;
+                else
+                    return false;
+                break;
+            case 5:
+                payload = words[i] & 0xFFFF;
+                if((words[i] >> 16) == 0x3)         // 011
+                    values[i] = payload;
+                else if((words[i] >> 16) == 0x4)    // 100
+                    values[i] = payload << 16;
+                else if((words[i] >> 16) == 0x5)    // 101
+                    values[i] = ((payload >> 8) << 16) | (payload & 0xFF);
+                else
+                    return false;
+                break;
+            case 8:
+                // 111
+                values[i] = words[i];
+                break;
+            default:
+                return false;
+        }
+    }
+    return true;
+}
+
+bool FRFCFS::BDIDecompress( uint64_t variant, uint64_t *words, const uint8_t *lengths, uint64_t count, uint8_t *line )
+{
+    static const uint64_t bsizes[BDICOUNT] = { 8, 8, 8, 8, 4, 4, 4, 2 };
+    uint64_t values[DFPCLINESIZE/2];
+    uint64_t bsize, n, nums, baseCount, base, i, j;
+    
+    if(variant >= BDICOUNT)
+        return false;
+    
+    bsize = bsizes[variant];
+    n = DFPCLINESIZE / bsize;
+    nums = (bsize > 4) ? 2 : 1;
+    
+    if(variant == 0 || variant == 4)
+    {
+        /* One 8- or 4-byte value repeated over the whole line. */
+        if(count != nums)
+            return false;
+        base = (nums == 2) ? ((words[0] << 32) | words[1]) : words[0];
+        for(i = 0; i < n; i++)
+            values[i] = base;
+    }
+    else
+    {
+        if(count <= n || (count - n) % nums != 0)
+            return false;
+        baseCount = (count - n) / nums;
+        if(baseCount > 2)
+            return false;
+        
+        /*
+         *  The stream has no per-word base selector. Deltas are applied to the
+         *  implicit zero base, or to the last stored base when there are two.
+         */
+        base = 0;
+        if(baseCount == 2)
+            base = (nums == 2) ? ((words[2] << 32) | words[3]) : words[1];
+        for(i = 0; i < n; i++)
+        {
+            if(lengths[count - n + i] > 2 * bsize)
+                return false;
+            values[i] = base + words[count - n + i];
+        }
+    }
+    
+    for(i = 0; i < n; i++)
+    {
+        for(j = 0; j < bsize; j++)
+            line[i*bsize + j] = static_cast<uint8_t>(values[i] >> (8*j));
+    }
+    return true;
+}
+
+bool FRFCFS::StaticDecompress( uint64_t *words, const uint8_t *lengths, uint64_t count, uint64_t *values )
+{
+    uint64_t i;
+    
+    // 000: the whole line is zero
+    if(count == 1 && lengths[0] == 1 && words[0] == 0)
+        return true;
+    if(count != DFPCLINESIZE/4)
+        return false;
+    
+    for(i = 0; i < count; i++)
+    {
+        if(lengths[i] == 1 && words[i] == 0x1)              // 001
+            values[i] = 0;
+        else if(lengths[i] == 5 && (words[i] >> 16) == 0x2) // 010
+            values[i] = words[i] & 0xFFFF;
+        else if(lengths[i] == 5 && (words[i] >> 16) == 0x3) // 011
+            values[i] = (words[i] & 0xFFFF) << 16;
+        else if(lengths[i] == 8)
+            values[i] = words[i];
+        else
+            return false;
+    }
+    return true;
+}
+
+/*
+ *  Dynamic FPC codewords are tried in the order DynamicFPCCompress assigns
+ *  them, so a codeword that matches several patterns decodes the same way
+ *  the encoder would have chosen it.
+ */
+bool FRFCFS::DynamicFPCDecompress( uint64_t *words, const uint8_t *lengths, uint64_t count, 
+                                   const DFPCPatternSet& patterns, uint64_t *values )
+{
+    uint64_t i;
+    
+    // 000: the whole line is zero
+    if(count == 1 && lengths[0] == 1 && words[0] == 0)
+        return true;
+    if(count != DFPCLINESIZE/4)
+        return false;
+    
+    for(i = 0; i < count; i++)
+    {
+        if(lengths[i] == 0 || lengths[i] > 8)
+            return false;
+        
+        uint64_t chars = lengths[i] - 1;
+        uint64_t prefix = words[i] >> (4 * chars);
+        uint64_t payload = words[i] & ((1ULL << (4 * chars)) - 1);
+        uint64_t j = prefix - 4;
+        bool masked = (prefix >= 4 && j < static_cast<uint64_t>(patterns.mask_pos)
+                       && static_cast<uint64_t>(8 - patterns.compressibleChars[j]) == chars);
+        
+        if(lengths[i] == 1 && words[i] == 0x1)              // 001
+            values[i] = 0;
+        else if(masked && chars < 4)
+            values[i] = ExpandMasked(payload, patterns.masks[j], chars);
+        else if(lengths[i] == 5 && prefix == 0x3)           // 011
+            values[i] = payload;
+        else if(lengths[i] == 5 && prefix == 0x4)           // 100
+            values[i] = payload << 16;
+        else if(masked)
+            values[i] = ExpandMasked(payload, patterns.masks[j], chars);
+        else if(lengths[i] == 3 && prefix == 0x6 && patterns.special_pattern_flag[0])  // 110
+            values[i] = (payload & 0xFF) * 0x01010101;
+        else if(lengths[i] == 8)
+            values[i] = words[i];
+        else
+            return false;
+    }
+    return true;
 }
 
-bool FRFCFS::StaticCompress(NVMainRequest *request, uint64_t size, bool flag )
+/* Place the payload nibbles, lowest first, into the zero nibbles of a mask. */
+uint64_t FRFCFS::ExpandMasked( uint64_t payload, uint64_t mask, uint64_t chars )
 {
-    uint64_t * values = convertByte2Word(request, flag, size*4, 8);
-    uint64_t i;
-    
-    uint64_t words[16];
-    uint64_t wordPos[16]; //0~8 chars
-    uint64_t comSize = 0;
-    bool comFlag = false;
+    uint64_t value = 0;
+    uint64_t k = 0;
     
-    if( isZeroPackable( values, size*4 / 8))
+    for(uint64_t n = 0; n < 8 && k < chars; n++)
     {
-        // 000
-        words[0] = 0;
-        wordPos[0] = 1;
-        comFlag = true;
-        comSize = 1;
-        free(values);
-        values = NULL;
-        Word2Byte(request, flag, comSize, comSize, words, wordPos);
-        return comFlag;
-    }
-    free(values);
-    values = convertByte2Word(request, flag, size*4, 4);
-    for (i = 0; i < size; i++) {
-     
-        // 001
-        if(values[i] == 0){
-            words[i] = values[i] + 0x1;
-            wordPos[i] = 1;
-            comSize += wordPos[i];
-            continue;
-        }
-        // 010
-        if(my_abs((int)(values[i])) <= 0xFFFF){
-            words[i] = my_abs((int)(values[i])) + 0x20000;
-            wordPos[i] = 5;
-            comSize += wordPos[i];
-            continue;
-        }
-        //011  
-        if(((values[i]) & 0xFFFF) == 0 ){
-            words[i] = (values[i] >> 16) + 0x30000;
-            wordPos[i] = 5;
-            comSize += wordPos[i];
-            continue;
+        if(((mask >> (4*n)) & 0xF) == 0)
+        {
+            value |= ((payload >> (4*k)) & 0xF) << (4*n);
+            k++;
         }
-        //uncompressible
-        words[i] = values[i];
-        wordPos[i] = 8;
-        comSize += wordPos[i];
-    }
-    if(comSize % 2 == 1)
-        comSize++;
-    comSize /= 2;
-    if(comSize < (size*4))
-    {
-        comFlag = true;
     }
-    if(comFlag)
-        Word2Byte(request, flag, size, comSize, words, wordPos);
-    free(values);
-    values = NULL;
-    return comFlag;
+    return value;
 }
 
-uint64_t FRFCFS::FPCIdentify(NVMainRequest *request, uint64_t size){
-    uint64_t * values = convertByte2Word(request, true, size*4, 4);
+uint64_t FRFCFS::FPCIdentify(uint64_t *values, uint64_t size, DFPCDictionary& dict){
     uint64_t i;
     for (i = 0; i < size; i++) {
         if(values[i] == 0){
             continue;
         }
         if(my_abs((int)(values[i])) <= 0xFF){
-			FPCCounter[0]++;
+			dict.FPCCounter[0]++;
+            dict.ranking.Update(0, CandidateScore(dict, 0));
             continue;
         }
         // 011
@@ -1492,7 +3536,8 @@ uint64_t FRFCFS::FPCIdentify(NVMainRequest *request, uint64_t size){
         //101
         if( my_abs((int)((values[i]) & 0xFFFF)) <= 0xFF
              && my_abs((int)((values[i] >> 16) & 0xFFFF)) <= 0xFF){
-            FPCCounter[1]++;
+            dict.FPCCounter[1]++;
+            dict.ranking.Update(1, CandidateScore(dict, 1));
 			
             continue;
         }
@@ -1502,109 +3547,103 @@ uint64_t FRFCFS::FPCIdentify(NVMainRequest *request, uint64_t size){
         uint64_t byte2 = (values[i] >> 16) & 0xFF;
         uint64_t byte3 = (values[i] >> 24) & 0xFF;
         if(byte0 == byte1 && byte0 == byte2 && byte0 == byte3){
-			FPCCounter[2]++;
+			dict.FPCCounter[2]++;
+            dict.ranking.Update(2, CandidateScore(dict, 2));
 			
             continue;
         }
         
     }
-    free(values);
-    values = NULL;
     return 1;
         
 }
 
-uint64_t FRFCFS::BDIIdentify (NVMainRequest *request, uint64_t _blockSize)
+/*
+ *  Size-only version of multBaseCompression for several delta widths at
+ *  once: each width gets the implicit zero base plus the first value that
+ *  does not fit it, all in a single sweep over the words.
+ */
+void FRFCFS::BaseDeltaSizes(uint64_t *values, uint64_t size, uint64_t bsize, const uint64_t *blimits, uint64_t count, uint64_t *sizes)
 {
- 
-    uint64_t * values = convertByte2Word(request, true, _blockSize, 8);
-    uint64_t bestCSize = _blockSize;
-    uint64_t currCSize = _blockSize;
-	bool isBest[8];
-	uint64_t currWords[34];
-    uint64_t currWordPos[34]; //0~8 chars
-    uint64_t pos;
-	for(int i=0;i<8;i++)
-	{
-		isBest[i] = false;
-	}
-    if( isSameValuePackable( values, _blockSize / 8))
-    {
-        currCSize = 8;
-		isBest[0] = true;
-    }
-    if(bestCSize > currCSize)
-    {
-        bestCSize = currCSize;
-    }
-    currCSize = multBaseCompression( values, _blockSize / 8, 1, 8, currWords, currWordPos, pos);
-    if(bestCSize > currCSize)
-    {
-        bestCSize = currCSize;
-		isBest[1] = true;
-    }
-    currCSize = multBaseCompression( values, _blockSize / 8, 2, 8, currWords, currWordPos, pos);
-    if(bestCSize > currCSize)
-    {
-        bestCSize = currCSize;
-		isBest[2] = true;
-    }
-    currCSize = multBaseCompression( values, _blockSize / 8, 4, 8, currWords, currWordPos, pos);
-    if(bestCSize > currCSize)
-    {
-        bestCSize = currCSize;
-		isBest[3] = true;
-    }
-    free(values);
-    values = convertByte2Word(request, true, _blockSize, 4);
-    if( isSameValuePackable( values, _blockSize / 4))
-    {
-        currCSize = 4;
-    }
-    if(bestCSize > currCSize)
-    {
-        bestCSize = currCSize;
-        isBest[4] = true;
-    }
-    currCSize = multBaseCompression( values, _blockSize / 4, 1, 4, currWords, currWordPos, pos);
-    if(bestCSize > currCSize)
+    uint64_t limits[3], bases[3], compCount[3];
+    bool hasBase[3];
+    uint64_t i, k;
+    
+    for(k = 0; k < count; k++)
     {
-        bestCSize = currCSize;
-        isBest[5] = true;
+        limits[k] = (blimits[k] == 1) ? 0xFF : (blimits[k] == 2) ? 0xFFFF : 0xFFFFFFFF;
+        bases[k] = 0;
+        compCount[k] = 0;
+        hasBase[k] = false;
     }
-    currCSize = multBaseCompression( values, _blockSize / 4, 2, 4, currWords, currWordPos, pos);
-    if(bestCSize > currCSize)
+    
+    for(i = 0; i < size; i++)
     {
-        bestCSize = currCSize;
-        isBest[6] = true;
+        for(k = 0; k < count; k++)
+        {
+            if(my_llabs((long long int)(0 - values[i])) <= limits[k])
+            {
+                compCount[k]++;
+            }
+            else if(!hasBase[k])
+            {
+                bases[k] = values[i];
+                hasBase[k] = true;
+                compCount[k]++;
+            }
+            else if(my_llabs((long long int)(bases[k] - values[i])) <= limits[k])
+            {
+                compCount[k]++;
+            }
+        }
     }
-    free(values);
-    values = convertByte2Word(request, true, _blockSize, 2);
-    currCSize = multBaseCompression( values, _blockSize / 2, 1, 2, currWords, currWordPos, pos);
-    if(bestCSize > currCSize)
+    
+    for(k = 0; k < count; k++)
     {
-        bestCSize = currCSize;
-        isBest[7] = true;
+        if(compCount[k] < size)
+            sizes[k] = size * bsize;
+        else
+            sizes[k] = blimits[k] * size + bsize * 2;
     }
-    free(values);
-    values = NULL;
-	for(int i=7;i>=0;i--)
+}
+
+uint64_t FRFCFS::BDIIdentify (uint64_t *words8, uint64_t *words4, uint64_t *words2, uint64_t _blockSize, DFPCDictionary& dict)
+{
+    static const uint64_t limits8[3] = { 1, 2, 4 };
+    static const uint64_t limits4[2] = { 1, 2 };
+    static const uint64_t limits2[1] = { 1 };
+    uint64_t sizes[8];
+    uint64_t bestCSize = _blockSize;
+    int best = -1;
+    
+    /* Same order as BDICompress: a later scheme only wins if strictly smaller. */
+    sizes[0] = isSameValuePackable( words8, _blockSize / 8) ? 8 : _blockSize;
+    BaseDeltaSizes( words8, _blockSize / 8, 8, limits8, 3, &sizes[1] );
+    sizes[4] = isSameValuePackable( words4, _blockSize / 4) ? 4 : _blockSize;
+    BaseDeltaSizes( words4, _blockSize / 4, 4, limits4, 2, &sizes[5] );
+    BaseDeltaSizes( words2, _blockSize / 2, 2, limits2, 1, &sizes[7] );
+    
+	for(int i = 0; i < BDICOUNT; i++)
 	{
-		if(isBest[i])
+		if(bestCSize > sizes[i])
 		{
-			BDICounter[i] += _blockSize - bestCSize;
-            BDIpatterncounter++;
-            break;
+            bestCSize = sizes[i];
+            best = i;
 		}
 	}
+    if(best >= 0)
+    {
+        dict.BDICounter[best] += _blockSize - bestCSize;
+        dict.BDIpatterncounter++;
+        dict.ranking.Update(BDICandidate(best), CandidateScore(dict, BDICandidate(best)));
+    }
     return 1;
 
 }
 
-uint64_t FRFCFS::Sample(NVMainRequest *request, uint64_t _blockSize)
+uint64_t FRFCFS::Sample(uint64_t *values, DFPCDictionary& dict)
 {
 	uint64_t num = 0;
-	uint64_t * values = convertByte2Word(request, true, _blockSize, 4);
 	for(int i = 0; i< 16;i++)
 	{
 		num = my_llabs((long long int)values[i]);
@@ -1612,92 +3651,46 @@ uint64_t FRFCFS::Sample(NVMainRequest *request, uint64_t _blockSize)
 		{
 			if((num & 0xF) == 0)
 			{
-				SampleCounter[ 8*i+j ]++;
+				dict.SampleCounter[ 8*i+j ]++;
 			}
 			num = (num >> 4);
 		}
 	}
-    free(values);
-    values = NULL;
 	return 1;
 }
 
-uint64_t FRFCFS::ExtractPattern()
+uint64_t FRFCFS::ExtractPattern(DFPCDictionary& dict)
 {
     int i, j, pos;
     bool flag;
-    uint64_t lower_bound, upper_bound, threshold;//, word_size;
+    uint64_t threshold;
     int word_count = SAMPLECOUNT/DYNAMICWORDSIZE; // 32-bit word
-    int total_pattern_count = FPCCOUNT+BDICOUNT+word_count;
     
     uint8_t SamplePatterns[SAMPLECOUNT];
     pattern_num = word_count / 2;
     uint8_t patterns_temp[word_count];
     int compressible_chars[word_count];
     uint8_t extracted_patterns[word_count];
-
-    uint64_t DynamicPatterns[total_pattern_count];
-    uint64_t CompressBytes[total_pattern_count];
     
+    /* FPC and BDI candidates are already ranked; only the samples are merged in. */
+    PatternRanking ranking = dict.ranking;
     
-	for(i = 0; i < FPCCOUNT; i++)
-    {
-        DynamicPatterns[i] = i;
-        if(i == 1)
-            //CompressBytes[i] = FPCCounter[i] - FPCCounter[i]/2 - FPCCounter[i] * 3 / 32;
-            CompressBytes[i] = FPCCounter[i]*4 - FPCCounter[i]*2 - FPCCounter[i] * 3  / 8;
-        //(FPCCounter[i] * 4 - FPCCounter[i] * 2 - FPCCounter[i] * 3  / 8) / 4;
-        else
-            //CompressBytes[i] = FPCCounter[i] - FPCCounter[i]/4 - FPCCounter[i] * 3 / 32;
-            CompressBytes[i] = FPCCounter[i]*4 - FPCCounter[i] - FPCCounter[i] * 3 / 8;
-        //FPCCompressBytes[i] = FPCCounter[i] * 22;
-        //(FPCCounter[i] + 3 * FPCCounter[i] / 8) * 64 / 4;
-        std::cout<<"FPCCompressBytes["<<i<<"]: "<<CompressBytes[i]<<std::endl;
-        FPCCounter[i] = 0;
-    }
-    
-    for(i = 0; i < BDICOUNT; i++)
-    {
-        CompressBytes[i + FPCCOUNT] = 0;
-    }
-    
-    for(i = 0; i < BDICOUNT; i++)
-    {
-        DynamicPatterns[i + FPCCOUNT] = i + FPCCOUNT;
-        //CompressBytes[i + FPCCOUNT] = (BDICounter[i] - 3 * BDIpatterncounter / 8)/64;
-        if(i < 4)
-            CompressBytes[0 + FPCCOUNT] += BDICounter[i];
-        else if(i < BDICOUNT - 1)
-            CompressBytes[4 + FPCCOUNT] += BDICounter[i];
-        else
-            CompressBytes[i + FPCCOUNT] = BDICounter[i];
-        //std::cout<<"BDICompressBytes["<<i<<"]: "<<CompressBytes[i+FPCCOUNT]<<std::endl;
-        BDICounter[i] = 0;
-    }
-    //    BDICounter[i] = BDICounter[i];
+    /* Build the new dictionary aside and swap it in at the end. */
+    DFPCPatternSet staged;
+    staged.mask_pos = 0;
+    staged.generation = dict.activePatterns.generation + 1;
+    for(i = 0; i <= BDICOUNT; i++)
+        staged.special_pattern_flag[i] = false;
 	
     //sample
-    lower_bound = upper_bound = SampleCounter[0];
-    
-    for(i = 1; i < SAMPLECOUNT; i++)
-    {
-        if(SampleCounter[i] < lower_bound)
-            lower_bound = SampleCounter[i];
-        else if(SampleCounter[i] > upper_bound)
-            upper_bound = SampleCounter[i];
-    }
-    ;
-    threshold = lower_bound + (upper_bound - lower_bound) * threshold_factor;
-    printf("%ld\n", threshold);
+    threshold = SampleThreshold(dict);
     for(i = 0; i < SAMPLECOUNT; i++)
     {
-        if(SampleCounter[i] < threshold)
+        if(dict.SampleCounter[i] < threshold)
             SamplePatterns[i] = 1;
         else
             SamplePatterns[i] = 0;
-        printf("%d\t", SamplePatterns[i]);
     }
-    printf("\n");
     
     //determine word_size
     
@@ -1709,10 +3702,10 @@ uint64_t FRFCFS::ExtractPattern()
             patterns_temp[i] = patterns_temp[i] + (SamplePatterns[ DYNAMICWORDSIZE*i+j ] << (7-j));
         }
     }
-    for(pattern_num = word_count / 2; pattern_num < word_count && pattern_num >= 1;pattern_num /= 2)
+    for(pattern_num = word_count / 2; pattern_num < (uint32_t)word_count && pattern_num >= 1;pattern_num /= 2)
     {
         flag = true;
-        for(i = 0; i < pattern_num; i++)
+        for(i = 0; i < (int)pattern_num; i++)
         {
             if(patterns_temp[i] != patterns_temp[i + pattern_num])
             {
@@ -1726,23 +3719,20 @@ uint64_t FRFCFS::ExtractPattern()
     }
     if(pattern_num == 0)
         pattern_num = 1;
-    printf("pattern_num: %d\n", pattern_num);
-    //word_size = pattern_num * 4;//word_size Bytes
     
     //dynamic patterns: extracted_patterns[0~(pos-1)]
-    for(pos = 0, i = 0; i < pattern_num; i++)
+    for(pos = 0, i = 0; i < (int)pattern_num; i++)
     {
         uint32_t compressible_char = 0;
-        uint64_t min_compression_counter = mem_writes;
-        printf("patterns_temp[%d]: %d\t", i, patterns_temp[i]);
+        uint64_t min_compression_counter = dfpcWrites;
         for(j = 0; j < DYNAMICWORDSIZE; j++)
         {
             uint8_t compression_tag = (patterns_temp[i] >> (7 - j)) & 0x1;
             if(compression_tag == 0)
             {
                 compressible_char++;
-                if(SampleCounter[ DYNAMICWORDSIZE*i+j ] < min_compression_counter)
-                    min_compression_counter = SampleCounter[ DYNAMICWORDSIZE*i+j ];
+                if(dict.SampleCounter[ DYNAMICWORDSIZE*i+j ] < min_compression_counter)
+                    min_compression_counter = dict.SampleCounter[ DYNAMICWORDSIZE*i+j ];
             }
         }
         if(compressible_char > 0 && compressible_char < DYNAMICWORDSIZE)
@@ -1760,30 +3750,24 @@ uint64_t FRFCFS::ExtractPattern()
             {
                 compressible_chars[pos] = compressible_char;
                 extracted_patterns[pos] = patterns_temp[i];
-                DynamicPatterns[pos + FPCCOUNT + BDICOUNT] = pos + FPCCOUNT + BDICOUNT;
-                CompressBytes[pos + FPCCOUNT + BDICOUNT] =   min_compression_counter * compressible_char / 2 - min_compression_counter * 3 / 8;//min_compression_counter * compressible_char / 2 - min_compression_counter * 3 / 8) / (DYNAMICWORDSIZE / 2);
-                //min_compression_counter * (70 - 8 * compressible_char);
-                //SampleCompressBytes[pos] = min_compression_counter * (70 - 8 * compressible_char);
-                std::cout<<"extracted_pattern: "<<extracted_patterns[pos]<<" CompressBytes["<<pos + FPCCOUNT + BDICOUNT<<"]: "<<CompressBytes[pos + FPCCOUNT + BDICOUNT]<<std::endl;
+                ranking.Update(pos + FPCCOUNT + BDICOUNT,
+                               min_compression_counter * compressible_char / 2 - min_compression_counter * 3 / 8);
                 pos++;
             }
-            //(min_compression_counter * compressible_char / 2 - min_compression_counter * 3 / 8) / (DYNAMICWORDSIZE / 2);
         }
     }
-    printf("\n");
-    HeapSort(DynamicPatterns, CompressBytes, pos + FPCCOUNT + BDICOUNT, 4);
-    int count;
-    for(i = 0, count = pos + FPCCOUNT + BDICOUNT - 1; i < 4; i++, count--)
+    
+    for(i = 0; i < ranking.count; i++)
     {
+        uint64_t candidate = ranking.ids[i];
         uint8_t pattern;
         uint64_t mask = 0;
-        if(DynamicPatterns[count] < FPCCOUNT)
+        if(candidate < FPCCOUNT)
         {
-            switch(DynamicPatterns[count])
+            switch(candidate)
             {
                 case 0:
-                    pattern = 3;
-                    printf("3\t"); //00000011
+                    pattern = 3; //00000011
                     for(j=0; j<8;j++)
                     {
                         if((pattern & 0x1) == 0)
@@ -1792,14 +3776,12 @@ uint64_t FRFCFS::ExtractPattern()
                         }
                         pattern = pattern >> 1;
                     }
-                    masks[mask_pos] = mask;
-                    std::cout<<" mask: "<<mask<<" ";
-                    compressibleChars[mask_pos++] = 6;
+                    staged.masks[staged.mask_pos] = mask;
+                    staged.compressibleChars[staged.mask_pos++] = 6;
                     
                     break;
 				case 1:
-                    pattern = 51;
-                    printf("51\t");//00110011
+                    pattern = 51; //00110011
                     for(j=0; j<8;j++)
                     {
                         if((pattern & 0x1) == 0)
@@ -1808,55 +3790,24 @@ uint64_t FRFCFS::ExtractPattern()
                         }
                         pattern = pattern >> 1;
                     }
-                    masks[mask_pos] = mask;
-                    std::cout<<" mask: "<<mask<<" ";
-                    compressibleChars[mask_pos++] = 4;
+                    staged.masks[staged.mask_pos] = mask;
+                    staged.compressibleChars[staged.mask_pos++] = 4;
                     
                     break;
                 case 2:
-                    special_pattern_flag[0] = true;
-                    printf("sameBytes\t");
+                    //sameBytes
+                    staged.special_pattern_flag[0] = true;
                     break;
             }
-            
-            //DynamicPatterns[count]
         }
-        else if(DynamicPatterns[count] < FPCCOUNT + BDICOUNT)
+        else if(candidate < FPCCOUNT + BDICOUNT)
         {
-            special_pattern_flag[1+DynamicPatterns[count] - FPCCOUNT] = true;
-            switch(DynamicPatterns[count] - FPCCOUNT)
-            {
-                case 0:
-                    printf("same64bitsWord\t");
-                    break;
-                case 1:
-                    printf("1-8\t");
-                    break;
-                case 2:
-                    printf("2-8\t");
-                    break;
-                case 3:
-                    printf("4-8\t");
-                    break;
-                case 4:
-                    printf("same32bitsWord\t");
-                    break;
-                case 5:
-                    printf("1-4\t");
-                    break;
-                case 6:
-                    printf("2-4\t");
-                    break;
-                case 7:
-                    printf("1-2\t");
-                    break;
-            }
-            //DynamicPatterns[count] - FPCCOUNT
+            //same64bitsWord/1-8/2-8/4-8, same32bitsWord/1-4/2-4 or 1-2
+            staged.special_pattern_flag[1 + candidate - FPCCOUNT] = true;
         }
         else
         {
-			pattern = extracted_patterns[DynamicPatterns[count] - FPCCOUNT - BDICOUNT];
-			printf("%d\t", pattern);
+			pattern = extracted_patterns[candidate - FPCCOUNT - BDICOUNT];
 			for(j=0; j<8;j++)
 			{
 				if((pattern & 0x1) == 0)
@@ -1865,60 +3816,219 @@ uint64_t FRFCFS::ExtractPattern()
 				}
 				pattern = pattern >> 1;
 			}
-            std::cout<<" mask: "<<mask<<" ";
-            std::cout<<" comChar: "<<compressible_chars[DynamicPatterns[count] - FPCCOUNT - BDICOUNT]<<" ";
-            masks[mask_pos] = mask;
-            compressibleChars[mask_pos++] = compressible_chars[DynamicPatterns[count] - FPCCOUNT - BDICOUNT];
-            
-            //extracted_patterns[DynamicPatterns[count] - FPCCOUNT - BDICOUNT]
+            staged.masks[staged.mask_pos] = mask;
+            staged.compressibleChars[staged.mask_pos++] = compressible_chars[candidate - FPCCOUNT - BDICOUNT];
         }
     }
-    printf("\n");
-    for(i = 0; i<mask_pos; i++)
+    
+    dict.retiredPatterns[dict.activePatterns.generation % DFPCHISTORY] = dict.activePatterns;
+    dict.activePatterns = staged;
+    
+    if(dfpcEpoch > 0)
+        PruneLineGenerations( );
+    
+    /* The next epoch samples from scratch. */
+    for(i = 0; i < FPCCOUNT; i++)
+        dict.FPCCounter[i] = 0;
+    for(i = 0; i < BDICOUNT; i++)
+        dict.BDICounter[i] = 0;
+    for(i = 0; i < SAMPLECOUNT; i++)
+        dict.SampleCounter[i] = 0;
+    dict.BDIpatterncounter = 0;
+    dict.ranking.Clear( );
+    
+    dict.sample_flag = false;
+	return 1;
+}
+
+/*
+ *  Drop the generation of lines whose pattern set has left the history of
+ *  every dictionary. They read back as warm-up lines, which is how they
+ *  are treated anyway, so the map only holds lines of recent epochs.
+ */
+void FRFCFS::PruneLineGenerations( )
+{
+    uint64_t oldest = dictionaries[0].activePatterns.generation;
+    
+    for(uint64_t i = 1; i < dictionaryCount; i++)
+        oldest = std::min(oldest, dictionaries[i].activePatterns.generation);
+    
+    if(oldest <= DFPCHISTORY || oldest - DFPCHISTORY <= prunedGeneration)
+        return;
+    
+    prunedGeneration = oldest - DFPCHISTORY;
+    
+    std::unordered_map<uint64_t, uint64_t>::iterator it = lineGeneration.begin( );
+    while(it != lineGeneration.end( ))
     {
-        std::cout<<" mask: "<<masks[i]<<" comChar: "<<compressibleChars[i]<<std::endl;
+        if(it->second < prunedGeneration)
+            it = lineGeneration.erase(it);
+        else
+            ++it;
     }
-    sample_flag = false;
-	return 1;
 }
 
-void FRFCFS::HeapAdjust(uint64_t pattern_array[], uint64_t bytes_array[],int pos,int nLength)
+/*
+ *  Nibbles sampled as zero fewer times than this are treated as significant.
+ */
+uint64_t FRFCFS::SampleThreshold(DFPCDictionary& dict)
 {
-    int i, nChild;
-    uint64_t nTemp;
-    for(i = pos; 2*i+1 < nLength; i = nChild)
+    uint64_t lower_bound, upper_bound;
+    
+    lower_bound = upper_bound = dict.SampleCounter[0];
+    
+    for(int i = 1; i < SAMPLECOUNT; i++)
     {
-        nChild = 2*i+1;
-        if((nChild < nLength-1) && (bytes_array[nChild+1] > bytes_array[nChild]))
-            ++nChild;
-        if(bytes_array[nChild] > bytes_array[i])
-        {
-            nTemp = bytes_array[i];
-            bytes_array[i] = bytes_array[nChild];
-            bytes_array[nChild] = nTemp;
-            
-            nTemp = pattern_array[i];
-            pattern_array[i] = pattern_array[nChild];
-            pattern_array[nChild] = nTemp;
-        }
-        else break;
+        if(dict.SampleCounter[i] < lower_bound)
+            lower_bound = dict.SampleCounter[i];
+        else if(dict.SampleCounter[i] > upper_bound)
+            upper_bound = dict.SampleCounter[i];
+    }
+    return lower_bound + (upper_bound - lower_bound) * threshold_factor;
+}
+
+/*
+ *  Inspect one in dfpcSampleRate writes of a dictionary.
+ */
+bool FRFCFS::SampleWrite(DFPCDictionary& dict)
+{
+    if(dict.sampleTick++ % dfpcSampleRate != 0)
+        return false;
+    
+    dfpc_sampled_writes++;
+    return true;
+}
+
+/*
+ *  Compare the selection ExtractPattern would make right now (the ranked
+ *  FPC/BDI candidates and the thresholded nibble map) with the previous
+ *  check. After dfpcStableChecks identical checks in a row the dictionary
+ *  is considered converged and, with DFPCEarlyWarmup, leaves warm-up.
+ */
+void FRFCFS::CheckConvergence(DFPCDictionary& dict)
+{
+    uint64_t signature[3] = { 0, 0, 0 };
+    uint64_t threshold = SampleThreshold(dict);
+    int i;
+    
+    for(i = 0; i < dict.ranking.count; i++)
+        signature[0] |= (dict.ranking.ids[i] + 1) << (8 * i);
+    for(i = 0; i < SAMPLECOUNT; i++)
+    {
+        if(dict.SampleCounter[i] < threshold)
+            signature[1 + i / 64] |= 1ULL << (i % 64);
+    }
+    
+    if(signature[0] == dict.signature[0] && signature[1] == dict.signature[1]
+       && signature[2] == dict.signature[2])
+    {
+        dict.stableChecks++;
+    }
+    else
+    {
+        dict.stableChecks = 0;
+        for(i = 0; i < 3; i++)
+            dict.signature[i] = signature[i];
+    }
+    
+    if(dfpcEarlyWarmup && !dict.converged && dict.stableChecks >= dfpcStableChecks)
+    {
+        dict.converged = true;
+        dfpc_early_warmups++;
+    }
+}
+
+double FRFCFS::Confidence(DFPCDictionary& dict)
+{
+    if(dict.stableChecks >= dfpcStableChecks)
+        return 1.0f;
+    
+    return static_cast<double>(dict.stableChecks) / static_cast<double>(dfpcStableChecks);
+}
+
+/*
+ *  Estimated bytes saved by an FPC or BDI candidate over the current epoch.
+ *  BDI candidates 0, 4 and 7 stand for the 8-byte, 4-byte and 2-byte base
+ *  groups; the other BDI slots never score.
+ */
+uint64_t FRFCFS::CandidateScore(DFPCDictionary& dict, uint64_t candidate)
+{
+    uint64_t score = 0;
+    
+    if(candidate < FPCCOUNT)
+    {
+        uint64_t hits = dict.FPCCounter[candidate];
+        
+        if(candidate == 1)
+            score = hits*4 - hits*2 - hits * 3 / 8;
+        else
+            score = hits*4 - hits - hits * 3 / 8;
+    }
+    else
+    {
+        uint64_t group = candidate - FPCCOUNT;
+        uint64_t last = group;
+        
+        if(group == 0)
+            last = 3;
+        else if(group == 4)
+            last = BDICOUNT - 2;
+        else if(group != BDICOUNT - 1)
+            return 0;
+        
+        for(uint64_t i = group; i <= last; i++)
+            score += dict.BDICounter[i];
     }
+    
+    return score;
+}
+
+uint64_t FRFCFS::BDICandidate(uint64_t scheme)
+{
+    if(scheme < 4)
+        return FPCCOUNT;
+    else if(scheme < BDICOUNT - 1)
+        return FPCCOUNT + 4;
+    
+    return FPCCOUNT + scheme;
+}
+
+void FRFCFS::PatternRanking::Clear( )
+{
+    count = 0;
 }
 
-void FRFCFS::HeapSort(uint64_t pattern_array[], uint64_t bytes_array[],int length, int topk)
+/*
+ *  Raise a candidate's score, keeping the DFPCTOPK best in descending order.
+ *  Scores only grow during an epoch, so an entry never has to move down.
+ */
+void FRFCFS::PatternRanking::Update( uint64_t id, uint64_t score )
 {
-    int i, count;
-    for(i = length/2-1; i >= 0; --i)
-        HeapAdjust(pattern_array, bytes_array, i , length);
-    for(i = length-1, count = 0; count < topk; --i, count++)
+    int i;
+    
+    if(score == 0)
+        return;
+    
+    for(i = 0; i < count && ids[i] != id; i++)
+        ;
+    
+    if(i == count)
     {
-        pattern_array[i]=pattern_array[0]^pattern_array[i];
-        pattern_array[0]=pattern_array[0]^pattern_array[i];
-        pattern_array[i]=pattern_array[0]^pattern_array[i];
+        if(count < DFPCTOPK)
+            count++;
+        else if(score <= scores[count - 1])
+            return;
         
-        bytes_array[i]=bytes_array[0]^bytes_array[i];
-        bytes_array[0]=bytes_array[0]^bytes_array[i];
-        bytes_array[i]=bytes_array[0]^bytes_array[i];
-        HeapAdjust(pattern_array, bytes_array,0,i);
+        i = count - 1;
+    }
+    
+    ids[i] = id;
+    scores[i] = score;
+    
+    while(i > 0 && scores[i - 1] < scores[i])
+    {
+        std::swap(ids[i - 1], ids[i]);
+        std::swap(scores[i - 1], scores[i]);
+        i--;
     }
-}
\ No newline at end of file
+}
@@ -35,17 +35,27 @@
 #define __FRFCFS_H__
 
 #include "src/MemoryController.h"
+#include "include/LatencyHistogram.h"
+#include "src/DebugLog.h"
+#include "src/Checkpoint.h"
 #include <deque>
+#include <map>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 //EDFPCscheme
 #define SAMPLECOUNT 128
 #define FPCCOUNT 3
 #define BDICOUNT 8
 #define DYNAMICWORDSIZE 8 //chars
+#define DFPCTOPK 4
+#define DFPCHISTORY 4 //retired pattern sets kept per dictionary
+#define DFPCLINESIZE 64 //bytes
 
 namespace NVM {
 
-class FRFCFS : public MemoryController
+class FRFCFS : public MemoryController, public Checkpointable
 {
   public:
     FRFCFS( );
@@ -62,21 +72,110 @@ class FRFCFS : public MemoryController
     void RegisterStats( );
     void CalculateStats( );
 
+    void SaveCheckpoint( std::ostream& out );
+    bool RestoreCheckpoint( std::istream& in );
+
   private:
-    NVMTransactionQueue *memQueue;
+    /*
+     *  Reads and writes are buffered separately. Reads are served first until
+     *  the write queue reaches the high watermark, then writes are drained
+     *  down to the low watermark.
+     */
+    enum QueueId
+    {
+        READ_QUEUE = 0,
+        WRITE_QUEUE = 1,
+        QUEUE_COUNT = 2
+    };
+
+    NVMTransactionQueue *readQueue;
+    NVMTransactionQueue *writeQueue;
+    bool draining;
+
+    /* 
+     *  Issued writes that may still be paused or cancelled. Each keeps its
+     *  write queue slot so re-queueing it never overfills the queue.
+     */
+    std::unordered_set<NVMainRequest *> pausableWrites;
+
+    /*
+     *  Per-bank view of each transaction queue in age order. Row buffer hit,
+     *  oldest ready and closed bank searches only visit the banks that can
+     *  accept a new transaction instead of walking the whole queue.
+     */
+    enum IndexedSearch
+    {
+        SEARCH_ROW_HIT,
+        SEARCH_OLDEST_READY,
+        SEARCH_CLOSED_BANK
+    };
+
+    struct IndexedTransaction
+    {
+        NVMTransactionQueue::iterator position; /* Location in its queue. */
+        ncounter_t queue;                       /* READ_QUEUE or WRITE_QUEUE. */
+        int64_t age;                            /* Smaller is older. */
+        ncycle_t writeEstimate;                 /* Expected cell write time. */
+        ncounter_t deferrals;                   /* Times skipped for reads. */
+    };
+
+    NVMTransactionQueue **bankQueues[QUEUE_COUNT];
+    std::map<NVMainRequest *, IndexedTransaction> indexedTransactions;
+    int64_t headAge, tailAge;
+
+    /*
+     *  VerifyIndexedScheduler repeats every indexed search with the linear
+     *  MemoryController search on a copy of the queue and counts (and
+     *  asserts on) any request the two would issue differently.
+     */
+    bool verifyIndexedScheduler;
+    uint64_t indexed_schedule_mismatches;
+
+    /* Compression-aware write drain. */
+    bool compressedWriteDrain;
+    ncycle_t shortWriteThreshold;
+    ncounter_t maxWriteDeferrals;
+    uint64_t long_write_deferrals;
+    uint64_t short_write_preferred;
+
+    /* Long writes held back by this cycle's searches, charged once something else issues. */
+    std::vector<NVMainRequest *> deferredWrites;
+
+    ncounter_t QueueFor( NVMainRequest *req );
+    bool ScheduleQueue( ncounter_t queue, NVMainRequest **nextRequest );
+    bool ScheduleDeferredWrites( NVMainRequest **nextRequest );
+    void EnqueueIndexed( NVMainRequest *req );
+    void PrequeueIndexed( NVMainRequest *req );
+    void RemoveIndexed( NVMainRequest *req );
+    bool FindIndexedRequest( ncounter_t queue, IndexedSearch search, 
+                             bool deferLongWrites, NVMainRequest **nextRequest );
+    bool DeferWrite( NVMainRequest *req, IndexedTransaction& entry, 
+                     ncounter_t rank, ncounter_t bank );
+    void ChargeDeferrals( NVMainRequest *issued );
+    void VerifyIndexedRequest( ncounter_t queue, IndexedSearch search, 
+                               NVMainRequest *indexed );
+    ncycle_t EstimateWriteLatency( NVMainRequest *request );
 
     /* Cached Configuration Variables*/
     uint64_t queueSize;
+    uint64_t readQueueSize;
+    uint64_t writeQueueSize;
+    uint64_t highWaterMark;
+    uint64_t lowWaterMark;
 
     /* Stats */
     uint64_t measuredLatencies, measuredQueueLatencies, measuredTotalLatencies;
     double averageLatency, averageQueueLatency, averageTotalLatency;
     uint64_t mem_reads, mem_writes;
+    uint64_t dfpcWrites;   /* Writes counted towards DFPCWarmup, kept across checkpoints. */
     uint64_t rb_hits;
     uint64_t rb_miss;
     uint64_t starvation_precharges;
     uint64_t cpu_insts;
     uint64_t write_pauses;
+    uint64_t write_drains;
+    uint64_t read_queue_full;
+    uint64_t write_queue_full;
 	//EDFPCscheme
     
     uint64_t bit_write;
@@ -89,6 +188,7 @@ class FRFCFS : public MemoryController
     bool Encoder (NVMainRequest *request, bool flag);
     bool GeneralEncoder (NVMainRequest *request);
     uint64_t GetChanges (NVMainRequest *request, uint32_t MLCLevels, bool DCWFlag);
+    uint64_t CellChanges (uint32_t *rawData, uint32_t *oldData, uint64_t memoryWordSize, uint32_t MLCLevels);
     uint64_t * convertByte2Word (NVMainRequest *request, bool flag, uint64_t size, uint64_t step);//flag: false-olddata true-newdata
     bool Word2Byte (NVMainRequest *request, bool flag, uint64_t size, uint64_t comSize, uint64_t *words, uint64_t *wordPos);//flag: false-olddata true-newdata
     
@@ -96,39 +196,348 @@ class FRFCFS : public MemoryController
     bool BDICompress (NVMainRequest *request, uint64_t _blockSize, bool flag );
     bool DFPCCompress(NVMainRequest *request, uint64_t _blockSize);
     
+    /*
+     *  A learned DFPC dictionary: the dynamic FPC masks and which FPC/BDI
+     *  special patterns are enabled. Each re-learning epoch builds a new set
+     *  and swaps it in as a whole.
+     */
+    struct DFPCPatternSet
+    {
+        uint64_t masks[FPCCOUNT+SAMPLECOUNT/DYNAMICWORDSIZE];
+        int compressibleChars[FPCCOUNT+SAMPLECOUNT/DYNAMICWORDSIZE];
+        bool special_pattern_flag[1+BDICOUNT];
+        int mask_pos;
+        uint64_t generation;
+    };
+    
+    /*
+     *  Running top-k of the FPC and BDI candidates, updated whenever their
+     *  sampling counters change. Sampled word patterns need the whole epoch
+     *  to be thresholded and are merged in by ExtractPattern.
+     */
+    struct PatternRanking
+    {
+        uint64_t ids[DFPCTOPK];
+        uint64_t scores[DFPCTOPK];
+        int count;
+        
+        void Clear( );
+        void Update( uint64_t id, uint64_t score );
+    };
+    
+    /*
+     *  Sampling counters and learned pattern sets of one dictionary. Lines
+     *  are mapped to a dictionary by bank or address region so that
+     *  unrelated data does not share a single learned pattern set.
+     */
+    struct DFPCDictionary
+    {
+        DFPCDictionary( );
+        
+        uint64_t FPCCounter[FPCCOUNT];
+        uint64_t BDICounter[BDICOUNT];
+        uint64_t SampleCounter[SAMPLECOUNT];
+        uint64_t BDIpatterncounter;
+        bool sample_flag;
+        uint64_t epochWrites;
+        PatternRanking ranking;
+        uint64_t sampleTick;     /* Writes seen for 1-in-N sampling. */
+        uint64_t samples;        /* Writes actually inspected. */
+        uint64_t signature[3];   /* Selection at the last convergence check. */
+        uint64_t stableChecks;   /* Consecutive checks without a change. */
+        bool converged;
+        DFPCPatternSet activePatterns;
+        DFPCPatternSet retiredPatterns[DFPCHISTORY];   /* Indexed by generation. */
+    };
+    
+    enum DictionaryScope
+    {
+        DICTIONARY_CHANNEL,
+        DICTIONARY_BANK,
+        DICTIONARY_REGION
+    };
+    
     
     bool isZeroPackable ( uint64_t * values, uint64_t size);
     bool isSameValuePackable ( uint64_t * values, uint64_t size);
     uint64_t multBaseCompression ( uint64_t * values, uint64_t size, uint64_t blimit, uint64_t bsize, uint64_t *currWords, uint64_t *currWordPos, uint64_t &pos);
     
     bool StaticCompress(NVMainRequest *request, uint64_t size, bool flag );
-    uint64_t FPCIdentify (NVMainRequest *request, uint64_t size);
-	uint64_t BDIIdentify (NVMainRequest *request, uint64_t _blockSize);
-	uint64_t Sample (NVMainRequest *request, uint64_t _blockSize);
-    uint64_t ExtractPattern();
-    void HeapSort(uint64_t pattern_array[], uint64_t bytes_array[],int length, int topk);
-    void HeapAdjust(uint64_t pattern_array[], uint64_t bytes_array[],int pos,int nLength);
-	bool DynamicCompress(NVMainRequest *request, uint64_t size, bool flag );
-    
-    uint64_t DynamicFPCCompress(NVMainRequest *request, uint64_t size, bool flag );
-    uint64_t DynamicBDICompress(NVMainRequest *request, uint64_t _blockSize, bool flag );
-    
-	uint64_t BDIpatterncounter;
-    bool sample_flag;
+    bool StaticEncode(NVMainRequest *request, bool flag, uint64_t size, uint64_t *words8, uint64_t *values );
+    void DecodeLine(NVMainRequest *request, bool flag, uint64_t *words8, uint64_t *words4, uint64_t *words2);
+    bool WarmupCompress(NVMainRequest *request, uint64_t _blockSize, DFPCDictionary& dict);
+    uint64_t FPCIdentify (uint64_t *values, uint64_t size, DFPCDictionary& dict);
+	uint64_t BDIIdentify (uint64_t *words8, uint64_t *words4, uint64_t *words2, uint64_t _blockSize, DFPCDictionary& dict);
+    void BaseDeltaSizes(uint64_t *values, uint64_t size, uint64_t bsize, const uint64_t *blimits, uint64_t count, uint64_t *sizes);
+	uint64_t Sample (uint64_t *values, DFPCDictionary& dict);
+    uint64_t ExtractPattern(DFPCDictionary& dict);
+    void PruneLineGenerations( );
+    uint64_t CandidateScore(DFPCDictionary& dict, uint64_t candidate);
+    uint64_t SampleThreshold(DFPCDictionary& dict);
+    bool SampleWrite(DFPCDictionary& dict);
+    void CheckConvergence(DFPCDictionary& dict);
+    double Confidence(DFPCDictionary& dict);
+    uint64_t BDICandidate(uint64_t scheme);
+	bool DynamicCompress(NVMainRequest *request, uint64_t size, bool flag, const DFPCPatternSet *patterns );
+    
+    /* A candidate encoding, kept aside until DynamicCompress picks a winner. */
+    struct DFPCEncoding
+    {
+        uint64_t words[34];
+        uint64_t wordPos[34]; //0~8 chars
+        uint64_t count;
+        uint64_t comSize;
+        uint64_t variant;   /* BDI base/delta variant, same numbering as BDICompress. */
+        uint8_t pattern[34]; /* Pattern slot of each codeword, see CountPatterns. */
+        bool compressed;
+    };
+    
+    uint64_t DynamicFPCCompress(uint64_t *words8, uint64_t *values, uint64_t size, const DFPCPatternSet& patterns, DFPCEncoding& enc );
+    uint64_t DynamicBDICompress(uint64_t *words8, uint64_t *words4, uint64_t *words2, uint64_t _blockSize, const DFPCPatternSet& patterns, DFPCEncoding& enc );
+    
+    void RelearnPatterns(NVMainRequest *request, uint64_t _blockSize, DFPCDictionary& dict);
+    const DFPCPatternSet *OldDataPatterns(NVMainRequest *request, DFPCDictionary& dict);
+    uint64_t DictionaryFor(NVMainRequest *request);
+    
     uint32_t pattern_num;
 	
 	uint64_t granularities;
     double threshold_factor;
-	uint64_t FPCCounter[FPCCOUNT];
-	uint64_t BDICounter[BDICOUNT];
-	uint64_t SampleCounter[SAMPLECOUNT];
-    uint64_t masks[FPCCOUNT+SAMPLECOUNT/DYNAMICWORDSIZE];
-    int compressibleChars[FPCCOUNT+SAMPLECOUNT/DYNAMICWORDSIZE];
-    bool special_pattern_flag[1+BDICOUNT];
-    int mask_pos;
+    DFPCDictionary *dictionaries;
+    uint64_t dictionaryCount;
+    DictionaryScope dictionaryScope;
+    uint64_t dictionaryRegionSize;
+    
+    /*
+     *  Epoch re-learning: 0 keeps the single warm-up dictionary. Lines
+     *  written since the oldest retired pattern set are mapped to the
+     *  generation they were written with (one entry per line); older and
+     *  warm-up lines have no entry and are read with the static scheme.
+     */
+    uint64_t dfpcEpoch;
+    std::unordered_map<uint64_t, uint64_t> lineGeneration;
+    uint64_t prunedGeneration;
+    uint64_t dfpc_relearns;
+    uint64_t dfpc_stale_lines;
+    
+    /* Warm-up sampling and convergence. */
+    uint64_t dfpcSampleRate;
+    uint64_t dfpcCheckInterval;
+    uint64_t dfpcStableChecks;
+    bool dfpcEarlyWarmup;
+    uint64_t dfpc_sampled_writes;
+    uint64_t dfpc_early_warmups;
+    double dfpc_confidence;
+    std::string dfpcPatternTable;  /* Active masks and special patterns per dictionary. */
     
     bool encodeFlag;
     uint64_t compressIndex;
+    
+    /*
+     *  Compressor and decompressor latencies per scheme in memory cycles. The
+     *  exposed part and the transfer size are carried to the subarray in the
+     *  data block; reads look up how their line was last stored.
+     */
+    enum CompressionScheme
+    {
+        SCHEME_NONE = 0,
+        SCHEME_FPC,
+        SCHEME_BDI,
+        SCHEME_DFPC_STATIC,
+        SCHEME_DFPC_DYNAMIC,
+        SCHEME_COUNT
+    };
+    
+    ncycle_t compressLatency[SCHEME_COUNT];
+    ncycle_t decompressLatency[SCHEME_COUNT];
+    ncycle_t encoderLatency;
+    ncycle_t decoderLatency;
+    bool codecPipelined;
+    bool trackLineSchemes;
+    CompressionScheme lastScheme;
+    struct StoredLine
+    {
+        uint8_t scheme;
+        bool encoded;
+        uint8_t size;   /* Bytes on the bus, 0 for a full line. */
+    };
+    
+    std::unordered_map<uint64_t, StoredLine> storedLines;
+    uint64_t storedLineLimit;
+    uint64_t stored_line_evictions;
+    uint64_t compression_cycles;
+    uint64_t decompression_cycles;
+    
+    /*
+     *  Pattern hits of the written lines per scheme. Slots below PATTERN_MASK
+     *  are the 3-bit FPC prefixes (the BDI variant for BDI lines), followed
+     *  by the dynamic DFPC masks and the dynamic DFPC BDI variants.
+     */
+    enum
+    {
+        PATTERN_MASK = 8,
+        PATTERN_BDI = PATTERN_MASK + FPCCOUNT + SAMPLECOUNT/DYNAMICWORDSIZE,
+        PATTERN_SLOTS = PATTERN_BDI + BDICOUNT
+    };
+    
+    uint64_t patternHits[SCHEME_COUNT][PATTERN_SLOTS];
+    uint64_t pendingPatterns[PATTERN_SLOTS];   /* Current write, until it is stored compressed. */
+    CompressionScheme pendingScheme;
+    std::map<uint64_t, uint64_t> compressedSizeMap[SCHEME_COUNT];
+    uint64_t uncompressed_bytes;
+    uint64_t compressed_bytes;
+    double aggregate_compress_ratio;
+    std::string patternHitsHisto;
+    std::string fpcSizeHisto;
+    std::string bdiSizeHisto;
+    std::string dfpcStaticSizeHisto;
+    std::string dfpcDynamicSizeHisto;
+    
+    void CountPatterns( CompressionScheme scheme, const uint8_t *pattern, uint64_t count );
+    void CommitPatterns( bool stored );
+    std::string PatternName( uint64_t scheme, uint64_t slot );
+    
+    ncycle_t ExposedCodecLatency( NVMainRequest *req, ncycle_t latency );
+    void SetWriteCodecLatency( NVMainRequest *req, bool encoderRan, bool encoded );
+    void SetReadCodecLatency( NVMainRequest *req );
+    void SetWriteTransferSize( NVMainRequest *req );
+    
+    /*
+     *  VerifyCompression keeps the compressed image of every written line and
+     *  decompresses it when the line is read back, comparing the result with
+     *  the read data. The codeword lengths stand in for the per-word metadata
+     *  a hardware decompressor reads; format is the DFPC sub-encoding.
+     */
+    enum { IMAGE_FPC = BDICOUNT };
+    
+    struct CompressedImage
+    {
+        uint8_t scheme;
+        uint8_t format;
+        bool encoded;
+        bool half;
+        uint64_t comSize;
+        uint64_t encodedSize;
+        uint64_t count;
+        uint8_t lengths[35];
+        uint8_t bytes[DFPCLINESIZE];
+        uint8_t encodedBytes[DFPCLINESIZE];
+        DFPCPatternSet patterns;
+    };
+    
+    bool verifyCompression;
+    CompressedImage writeImage;
+    std::unordered_map<uint64_t, CompressedImage> lineImages;
+    std::map<uint64_t, uint64_t> roundtripFailureMap;
+    uint64_t verified_reads;
+    uint64_t roundtrip_failures;
+    uint64_t encoder_roundtrip_failures;
+    std::string roundtripFailureHisto;
+    
+    void CaptureImage( NVMainRequest *req );
+    void StoreImage( NVMainRequest *req, bool encoded );
+    void VerifyRead( NVMainRequest *req );
+    bool DecompressImage( const CompressedImage& image, uint8_t *line );
+    bool DecodeCells( const CompressedImage& image, uint8_t *bytes );
+    bool FPCDecompress( uint64_t *words, const uint8_t *lengths, uint64_t count, uint64_t *values );
+    bool BDIDecompress( uint64_t variant, uint64_t *words, const uint8_t *lengths, uint64_t count, uint8_t *line );
+    bool StaticDecompress( uint64_t *words, const uint8_t *lengths, uint64_t count, uint64_t *values );
+    bool DynamicFPCDecompress( uint64_t *words, const uint8_t *lengths, uint64_t count, 
+                               const DFPCPatternSet& patterns, uint64_t *values );
+    uint64_t ExpandMasked( uint64_t payload, uint64_t mask, uint64_t chars );
+    
+    /*
+     *  PackedLines stores compressed lines back to back in column slots of
+     *  their home bank. The line-location table maps each line to its slot;
+     *  a bank appends lines to its open slot and only relocates a line once
+     *  it outgrows the space it was given. Table lookups go through a small
+     *  direct-mapped metadata cache and cost LineTableLatency on a miss.
+     */
+    struct LineLocation
+    {
+        uint64_t slot;      /* Column slot in the bank, row-major. */
+        uint8_t offset;     /* Byte offset in the slot. */
+        uint8_t space;      /* Bytes allocated to the line. */
+    };
+    
+    struct OpenSlot
+    {
+        uint64_t slot;
+        uint64_t used;
+    };
+    
+    bool packedLines;
+    ncycle_t lineTableLatency;
+    uint64_t lineTableCacheSize;
+    std::vector<uint64_t> lineTableCache;
+    std::unordered_map<uint64_t, LineLocation> lineTable;
+    std::unordered_map<uint64_t, std::vector<uint64_t> > slotLines;   /* Lines in each slot. */
+    OpenSlot **openSlots;
+    
+    /*
+     *  Packed slots live in the top packedRegionRows rows of every bank, so
+     *  the address mapping should leave those rows unused. Reads that still
+     *  find their home location there count as packed_region_conflicts.
+     */
+    uint64_t packedRegionRows;
+    uint64_t packedBaseRow;
+    uint64_t slotsPerBank;
+    uint64_t packed_lines;
+    uint64_t packed_slots;
+    uint64_t line_relocations;
+    uint64_t line_evictions;
+    uint64_t packed_region_conflicts;
+    uint64_t line_table_misses;
+    uint64_t packed_dead_bytes;
+    double effective_capacity;
+    
+    void PlaceLine( NVMainRequest *req );
+    void EvictSlot( NVMainRequest *req, uint64_t slot );
+    void LocateLine( NVMainRequest *req );
+    void MapToSlot( NVMainRequest *req, uint64_t slot );
+    uint64_t SlotKey( NVMainRequest *req, uint64_t slot );
+    ncycle_t LineTableLookup( uint64_t address );
+    
+    /*
+     *  Joint Flip-N-Write and compression: each line is stored raw,
+     *  compressed, or compressed with flip partitions applied to the stored
+     *  payload, whichever changes the fewest TLC cells. The stored format
+     *  and flip mask of every line are kept so the next write compares
+     *  against the cells as they are actually stored.
+     */
+    bool jointFlipEncoding;
+    uint64_t jointFlipGranularity;
+    uint64_t jointFlipMask;
+    
+    struct JointLine
+    {
+        bool compressed;    /* Stored as the compressed payload, not raw. */
+        uint64_t flipMask;  /* Partitions of the payload stored inverted. */
+    };
+    
+    std::unordered_map<uint64_t, JointLine> jointLines;
+    uint64_t joint_raw_lines;
+    uint64_t joint_compressed_lines;
+    uint64_t joint_flipped_lines;
+    uint64_t joint_flipped_partitions;
+    
+    void JointEncode( NVMainRequest *req );
+    void FlipPayload( uint8_t *bytes, uint64_t partition, uint64_t bits );
+    uint64_t FlagCellChanges( uint64_t mask, uint64_t oldMask );
+    
+    /*
+     *  Time paused or cancelled writes spend interrupted, from their first
+     *  issue to the issue that finally completes them. Writes that are never
+     *  interrupted count as zero so the percentiles cover all writes.
+     */
+    std::unordered_map<NVMainRequest *, ncycle_t> interruptedWrites;
+    LatencyHistogram writePauseLatency;
+    std::vector<double> latencyPercentiles;
+    std::string writePauseLatencyPercentiles;
+    
+    void RecordWritePause( NVMainRequest *request );
+    
+    DebugLog debugLog;
 };
 
 };
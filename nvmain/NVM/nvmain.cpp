@@ -37,6 +37,8 @@
 #include "src/Interconnect.h"
 #include "src/SimInterface.h"
 #include "src/EventQueue.h"
+#include "src/StatsStream.h"
+#include "src/Checkpoint.h"
 #include "Interconnect/InterconnectFactory.h"
 #include "MemControl/MemoryControllerFactory.h"
 #include "traceWriter/TraceWriterFactory.h"
@@ -48,6 +50,7 @@
 
 #include <sstream>
 #include <cassert>
+#include <cmath>
 
 using namespace NVM;
 
@@ -66,6 +69,25 @@ NVMain::NVMain( )
     prefetcher = NULL;
     successfulPrefetches = 0;
     unsuccessfulPrefetches = 0;
+
+    pendingRequestCount = 0;
+
+    outstandingRequests = NULL;
+    channelIdleCycles = NULL;
+    idleSettleCycles = 0;
+    skippedChannelCycles = 0;
+    fastForwardedCycles = 0;
+
+    averageReadLatency = 0.0;
+    averageWriteLatency = 0.0;
+
+    statsStream = NULL;
+    statsStreamCycles = 0;
+    statsStreamRequests = 0;
+    nextStreamCycle = 0;
+    completedRequests = 0;
+
+    checkpointSaveCycle = 0;
 	
 	num_read_requests = 0;
 	sum_read_latency = 0;
@@ -75,6 +97,9 @@ NVMain::NVMain( )
 
 NVMain::~NVMain( )
 {
+    if( statsStream )
+        delete statsStream;
+
     if( config ) 
         delete config;
     
@@ -92,6 +117,12 @@ NVMain::~NVMain( )
     if( translator )
         delete translator;
 
+    if( outstandingRequests )
+        delete [] outstandingRequests;
+
+    if( channelIdleCycles )
+        delete [] channelIdleCycles;
+
     if( channelConfig )
     {
         for( unsigned int i = 0; i < numChannels; i++ )
@@ -118,6 +149,7 @@ void NVMain::SetConfig( Config *conf, std::string memoryName, bool createChildre
     SetParams( params );
 
     StatName( memoryName );
+    debugLog.SetConfig( conf, p, "NVMain" );
 
     config = conf;
     if( config->GetSimInterface( ) != NULL )
@@ -188,7 +220,8 @@ void NVMain::SetConfig( Config *conf, std::string memoryName, bool createChildre
                     channelConfigFile += config->GetString( confString.str( ) );
                 }
                 
-                std::cout << "Reading channel config file: " << channelConfigFile << std::endl;
+                if( debugLog.Enabled( ) )
+                    debugLog.Log( ) << "Reading channel config file: " << channelConfigFile << std::endl;
 
                 channelConfig[i]->Read( channelConfigFile );
             }
@@ -220,10 +253,32 @@ void NVMain::SetConfig( Config *conf, std::string memoryName, bool createChildre
     if( p->MemoryPrefetcher != "none" )
     {
         prefetcher = PrefetcherFactory::CreateNewPrefetcher( p->MemoryPrefetcher );
-        std::cout << "Made a " << p->MemoryPrefetcher << " prefetcher." << std::endl;
+        if( debugLog.Enabled( ) )
+            debugLog.Log( ) << "Made a " << p->MemoryPrefetcher << " prefetcher." << std::endl;
     }
 
     numChannels = static_cast<unsigned int>(p->CHANNELS);
+
+    pendingMemoryRequests.resize( numChannels );
+
+    outstandingRequests = new ncounter_t[numChannels];
+    channelIdleCycles = new ncycle_t[numChannels];
+    for( unsigned int i = 0; i < numChannels; i++ )
+    {
+        outstandingRequests[i] = 0;
+        channelIdleCycles[i] = 0;
+    }
+
+    /* Give the controllers time to power down idle ranks before skipping them. */
+    if( p->UseLowPower )
+        idleSettleCycles = MAX( p->tRDPDEN, MAX( p->tWRPDEN, p->tWRAPDEN ) ) + p->tPD;
+
+    LatencyHistogram::ParsePercentiles( p->LatencyPercentiles, latencyPercentiles );
+    for( int type = 0; type < LATENCY_TYPES; type++ )
+    {
+        channelLatency[type].resize( numChannels );
+        bankLatency[type].resize( numChannels * p->RANKS * p->BANKS );
+    }
     
     std::string pretraceFile;
 
@@ -240,7 +295,8 @@ void NVMain::SetConfig( Config *conf, std::string memoryName, bool createChildre
             pretraceFile += config->GetString( "PreTraceFile" );
         }
 
-        std::cout << "Using trace file " << pretraceFile << std::endl;
+        if( debugLog.Enabled( ) )
+            debugLog.Log( ) << "Using trace file " << pretraceFile << std::endl;
 
         if( config->GetString( "PreTraceWriter" ) == "" )
             preTracer = TraceWriterFactory::CreateNewTraceWriter( "NVMainTrace" );
@@ -253,9 +309,56 @@ void NVMain::SetConfig( Config *conf, std::string memoryName, bool createChildre
             preTracer->SetEcho( true );
     }
 
+    if( config->GetString( "StatsStream" ) != "" )
+    {
+        std::string streamFile = ConfigFilePath( config->GetString( "StatsStream" ) );
+
+        config->GetValueUL( "StatsStreamCycles", statsStreamCycles );
+        config->GetValueUL( "StatsStreamRequests", statsStreamRequests );
+        nextStreamCycle = statsStreamCycles;
+
+        statsStream = new StatsStream( );
+        if( !statsStream->Open( streamFile, config->GetString( "StatsStreamFormat" ) ) )
+        {
+            delete statsStream;
+            statsStream = NULL;
+        }
+        else if( debugLog.Enabled( ) )
+        {
+            debugLog.Log( ) << "Streaming stats to " << streamFile << std::endl;
+        }
+    }
+
+    if( config->GetString( "CheckpointSave" ) != "" )
+    {
+        checkpointSaveFile = ConfigFilePath( config->GetString( "CheckpointSave" ) );
+        config->GetValueUL( "CheckpointSaveCycle", checkpointSaveCycle );
+    }
+
+    /* Children are configured by now, so their learned state can be loaded. */
+    if( createChildren && config->GetString( "CheckpointRestore" ) != "" )
+    {
+        std::string restoreFile = ConfigFilePath( config->GetString( "CheckpointRestore" ) );
+
+        if( !RestoreCheckpoint( restoreFile ) )
+        {
+            std::cerr << "NVMain: Could not restore checkpoint " << restoreFile 
+                      << "; starting cold." << std::endl;
+        }
+    }
+
     RegisterStats( );
 }
 
+/* Relative paths in the config are relative to the config file. */
+std::string NVMain::ConfigFilePath( std::string file )
+{
+    if( file[0] == '/' )
+        return file;
+
+    return NVM::GetFilePath( config->GetFileName( ) ) + file;
+}
+
 bool NVMain::IsIssuable( NVMainRequest *request, FailReason *reason )
 {
     uint64_t channel, rank, bank, row, col, subarray;
@@ -295,7 +398,15 @@ void NVMain::GeneratePrefetches( NVMainRequest *request, std::vector<NVMAddress>
         //          << request->address.GetPhysicalAddress( ) << std::dec << std::endl;
 
         /* Just type to issue; If the queue is full it simply won't be enqueued. */
-        GetChild( pfRequest )->IssueCommand( pfRequest );
+        if( GetChild( pfRequest )->IssueCommand( pfRequest ) )
+        {
+            ncounter_t pfChannel, pfRank, pfBank;
+
+            Locate( pfRequest, &pfChannel, &pfRank, &pfBank );
+
+            outstandingRequests[pfChannel]++;
+            channelIdleCycles[pfChannel] = 0;
+        }
     }
 }
 
@@ -319,33 +430,26 @@ void NVMain::IssuePrefetch( NVMainRequest *request )
 bool NVMain::CheckPrefetch( NVMainRequest *request )
 {
     bool rv = false;
-    NVMainRequest *pfRequest = NULL;
-    std::list<NVMainRequest *>::const_iterator iter;
+    PrefetchIndex::iterator hit;
     std::vector<NVMAddress> prefetchList;
 
-    for( iter = prefetchBuffer.begin(); iter!= prefetchBuffer.end(); iter++ )
+    hit = prefetchIndex.find( request->address.GetPhysicalAddress() );
+
+    if( hit != prefetchIndex.end() )
     {
-        if( (*iter)->address.GetPhysicalAddress() == request->address.GetPhysicalAddress() )
+        if( prefetcher->NotifyAccess(request, prefetchList) )
         {
-            if( prefetcher->NotifyAccess(request, prefetchList) )
-            {
-                GeneratePrefetches( request, prefetchList );
-            }
-
-            successfulPrefetches++;
-            rv = true;
-            pfRequest = (*iter);
-            delete pfRequest;
-            break;
+            GeneratePrefetches( request, prefetchList );
         }
-    }
 
-    if( pfRequest != NULL )
-    {
+        successfulPrefetches++;
+        rv = true;
+
         //std::cout << "Prefetched 0x" << std::hex << request->address.GetPhysicalAddress( )
-        //          << std::dec << " (list size " << prefetchBuffer.size() << " -> ";
-        prefetchBuffer.remove( pfRequest );
-        //std::cout << prefetchBuffer.size() << ")" << std::endl;
+        //          << std::dec << " (list size " << prefetchBuffer.size() << ")" << std::endl;
+        delete *(hit->second);
+        prefetchBuffer.erase( hit->second );
+        prefetchIndex.erase( hit );
     }
 
     return rv;
@@ -395,6 +499,9 @@ bool NVMain::IssueCommand( NVMainRequest *request )
         GetEventQueue()->InsertEvent( EventResponse, this, request, 
                                       GetEventQueue()->GetCurrentCycle() + 1 );
 
+        /* The response comes back through RequestComplete like any other. */
+        outstandingRequests[channel]++;
+
         return true;
     }
 
@@ -402,6 +509,9 @@ bool NVMain::IssueCommand( NVMainRequest *request )
     mc_rv = GetChild( request )->IssueCommand( request );
     if( mc_rv == true )
     {
+        outstandingRequests[channel]++;
+        channelIdleCycles[channel] = 0;
+
         IssuePrefetch( request );
 
         if( request->type == READ ) 
@@ -465,6 +575,21 @@ bool NVMain::IssueAtomic( NVMainRequest *request )
 bool NVMain::RequestComplete( NVMainRequest *request )
 {
     bool rv = false;
+    ncounter_t channel, rank, bank;
+
+    Locate( request, &channel, &rank, &bank );
+
+    if( outstandingRequests[channel] > 0 )
+        outstandingRequests[channel]--;
+
+    RecordLatency( request, channel, rank, bank );
+
+    completedRequests++;
+    if( statsStream && statsStreamRequests 
+        && completedRequests % statsStreamRequests == 0 )
+    {
+        StreamStats( );
+    }
 
 	
 	if(request->type == READ)
@@ -488,18 +613,31 @@ bool NVMain::RequestComplete( NVMainRequest *request )
             //          << ")." << std::endl;
 
             /* Place in prefetch buffer. */
-            if( prefetchBuffer.size() >= p->PrefetchBufferSize )
+            uint64_t pfAddress = request->address.GetPhysicalAddress( );
+
+            if( prefetchIndex.count( pfAddress ) )
             {
-                unsuccessfulPrefetches++;
-                //std::cout << "Prefetch buffer is full. Removing oldest prefetch: 0x" << std::hex
-                //          << prefetchBuffer.front()->address.GetPhysicalAddress() << std::dec
-                //          << std::endl;
+                /* Address is already buffered; keep the older copy. */
+                delete request;
+            }
+            else
+            {
+                if( prefetchBuffer.size() >= p->PrefetchBufferSize )
+                {
+                    unsuccessfulPrefetches++;
+                    //std::cout << "Prefetch buffer is full. Removing oldest prefetch: 0x" << std::hex
+                    //          << prefetchBuffer.front()->address.GetPhysicalAddress() << std::dec
+                    //          << std::endl;
+
+                    prefetchIndex.erase( prefetchBuffer.front()->address.GetPhysicalAddress() );
+                    delete prefetchBuffer.front();
+                    prefetchBuffer.pop_front();
+                }
 
-                delete prefetchBuffer.front();
-                prefetchBuffer.pop_front();
+                prefetchBuffer.push_back( request );
+                prefetchIndex[pfAddress] = --prefetchBuffer.end();
             }
 
-            prefetchBuffer.push_back( request );
             rv = true;
         }
         else
@@ -516,17 +654,26 @@ bool NVMain::RequestComplete( NVMainRequest *request )
     /* This is used in the main memory system when a DRAMCache is present.
      * DRAMCache misses need to issue main memory requests than might not
      * be issuable at that time. Try to issue these here. */
-    if( !pendingMemoryRequests.empty() ){
-       NVMainRequest *staleMemReq = pendingMemoryRequests.front();
-        if( IsIssuable(staleMemReq, NULL) ) {
-            IssueCommand( staleMemReq );
-            pendingMemoryRequests.pop();
-        }
-    }
+    IssuePendingRequests( channel );
 
     return rv;
 }
 
+/* Issues the channel's pending requests in order until one does not fit. */
+void NVMain::IssuePendingRequests( ncounter_t channel )
+{
+    std::queue<NVMainRequest *>& pending = pendingMemoryRequests[channel];
+
+    while( !pending.empty( ) && IsIssuable( pending.front( ), NULL ) )
+    {
+        if( !IssueCommand( pending.front( ) ) )
+            break;
+
+        pending.pop( );
+        pendingRequestCount--;
+    }
+}
+
 void NVMain::Cycle( ncycle_t steps )
 {
     assert( !p->EventDriven );
@@ -552,12 +699,343 @@ void NVMain::Cycle( ncycle_t steps )
         return;
     }
 
+    /* Retry pending requests every cycle rather than only on completions. */
+    if( pendingRequestCount > 0 )
+    {
+        for( unsigned int i = 0; i < numChannels; i++ )
+            IssuePendingRequests( i );
+    }
+
     for( unsigned int i = 0; i < numChannels; i++ )
     {
+        /* An idle controller would only rescan its empty queues. */
+        if( p->IdleFastForward && ChannelIdle( i ) )
+        {
+            skippedChannelCycles++;
+            continue;
+        }
+
         memoryControllers[i]->Cycle( 1 );
+
+        if( outstandingRequests[i] == 0 )
+            channelIdleCycles[i]++;
     }
 
     GetEventQueue()->Loop( steps );
+
+    CheckStreamCycle( );
+    CheckCheckpointSave( );
+}
+
+/*
+ *  Hands a snapshot of every registered stat to the stats stream, which
+ *  computes the deltas and writes it out in the background. The simulator
+ *  stalls while the snapshot is taken: CalculateStats updates the derived
+ *  stats in place and PrintAll reads the live counters, so both must run
+ *  on this thread. Keep StatsStreamCycles large enough to amortize it.
+ */
+void NVMain::StreamStats( )
+{
+    std::stringstream snapshot;
+
+    CalculateStats( );
+    GetStats( )->PrintAll( snapshot );
+
+    statsStream->Push( GetEventQueue( )->GetCurrentCycle( ), completedRequests, snapshot.str( ) );
+}
+
+void NVMain::CheckStreamCycle( )
+{
+    ncycle_t currentCycle = GetEventQueue( )->GetCurrentCycle( );
+
+    if( !statsStream || !statsStreamCycles || currentCycle < nextStreamCycle )
+        return;
+
+    StreamStats( );
+
+    /* A fast-forward may cross several intervals; stream once for all of them. */
+    nextStreamCycle = (currentCycle / statsStreamCycles + 1) * statsStreamCycles;
+}
+
+void NVMain::CheckCheckpointSave( )
+{
+    if( checkpointSaveFile == "" 
+        || GetEventQueue( )->GetCurrentCycle( ) < checkpointSaveCycle )
+        return;
+
+    /* Keep trying on later cycles until the controllers have drained. */
+    if( SaveCheckpoint( checkpointSaveFile ) )
+        checkpointSaveFile = "";
+}
+
+/*
+ *  Collects every object below this one that implements Checkpointable,
+ *  keyed by stat name, which is unique within the memory system.
+ */
+void NVMain::FindCheckpointables( NVMObject *object, 
+                                  std::map<std::string, Checkpointable *>& objects )
+{
+    std::vector<NVMObject_hook *>& children = object->GetChildren( );
+    std::vector<NVMObject_hook *>::iterator it;
+
+    for( it = children.begin( ); it != children.end( ); it++ )
+    {
+        NVMObject *child = (*it)->GetTrampoline( );
+        Checkpointable *checkpointable = dynamic_cast<Checkpointable *>( child );
+
+        if( checkpointable != NULL )
+            objects[child->StatName( )] = checkpointable;
+
+        FindCheckpointables( child, objects );
+    }
+}
+
+/*
+ *  Writes the learned state of the memory system (compression dictionaries,
+ *  compressed line records, encoder tags) to file. Requests in flight belong
+ *  to the simulator driving NVMain and cannot be saved, so this fails until
+ *  every channel has drained.
+ */
+bool NVMain::SaveCheckpoint( std::string file )
+{
+    std::map<std::string, Checkpointable *> objects;
+    std::map<std::string, Checkpointable *>::iterator it;
+
+    if( !config || !memoryControllers || pendingRequestCount > 0 )
+        return false;
+
+    for( unsigned int i = 0; i < numChannels; i++ )
+    {
+        if( outstandingRequests[i] > 0 )
+            return false;
+    }
+
+    std::ofstream out( file.c_str( ), std::ios::out | std::ios::binary | std::ios::trunc );
+
+    if( !out.is_open( ) )
+    {
+        std::cerr << "NVMain: Could not open checkpoint " << file << std::endl;
+        return false;
+    }
+
+    FindCheckpointables( this, objects );
+
+    out.write( "NVMCKPT1", 8 );
+    CheckpointWrite( out, static_cast<uint64_t>( objects.size( ) ) );
+
+    for( it = objects.begin( ); it != objects.end( ); it++ )
+    {
+        std::ostringstream blob;
+
+        it->second->SaveCheckpoint( blob );
+
+        CheckpointWrite( out, it->first );
+        CheckpointWrite( out, blob.str( ) );
+    }
+
+    if( debugLog.Enabled( ) )
+    {
+        debugLog.Log( ) << "Saved checkpoint of " << objects.size( ) << " objects to "
+                        << file << " at cycle " << GetEventQueue( )->GetCurrentCycle( ) 
+                        << std::endl;
+    }
+
+    return out.good( );
+}
+
+/*
+ *  Loads a checkpoint written by SaveCheckpoint. Records are matched to
+ *  objects by stat name; objects without a record, or whose record does not
+ *  fit the current configuration, keep their cold state.
+ */
+bool NVMain::RestoreCheckpoint( std::string file )
+{
+    std::map<std::string, Checkpointable *> objects;
+    std::map<std::string, Checkpointable *>::iterator found;
+    char magic[8];
+    uint64_t records;
+    ncounter_t restored = 0;
+
+    std::ifstream in( file.c_str( ), std::ios::in | std::ios::binary );
+
+    if( !in.is_open( ) )
+        return false;
+
+    in.read( magic, 8 );
+    if( !in.good( ) || std::string( magic, 8 ) != "NVMCKPT1" 
+        || !CheckpointRead( in, records ) )
+        return false;
+
+    FindCheckpointables( this, objects );
+
+    for( uint64_t i = 0; i < records; i++ )
+    {
+        std::string name, blob;
+
+        if( !CheckpointRead( in, name ) || !CheckpointRead( in, blob ) )
+            return false;
+
+        found = objects.find( name );
+        if( found == objects.end( ) )
+            continue;
+
+        std::istringstream blobStream( blob );
+
+        if( found->second->RestoreCheckpoint( blobStream ) )
+            restored++;
+        else
+            std::cerr << "NVMain: Checkpoint record for " << name 
+                      << " is truncated or does not match the configuration;"
+                      << " keeping its cold state." << std::endl;
+    }
+
+    if( debugLog.Enabled( ) )
+    {
+        debugLog.Log( ) << "Restored " << restored << " of " << records 
+                        << " checkpoint records from " << file << std::endl;
+    }
+
+    return true;
+}
+
+void NVMain::Locate( NVMainRequest *request, ncounter_t *channel, 
+                     ncounter_t *rank, ncounter_t *bank )
+{
+    ncounter_t row, col, subarray;
+
+    GetDecoder( )->Translate( request->address.GetPhysicalAddress( ), 
+                           &row, &col, bank, rank, channel, &subarray );
+}
+
+void NVMain::RecordLatency( NVMainRequest *request, ncounter_t channel, 
+                            ncounter_t rank, ncounter_t bank )
+{
+    int type;
+
+    if( request->type == READ || request->type == READ_PRECHARGE )
+        type = LATENCY_READ;
+    else if( request->type == WRITE || request->type == WRITE_PRECHARGE )
+        type = LATENCY_WRITE;
+    else
+        return;
+
+    /* Prefetch buffer hits are answered here and never issued. */
+    if( request->completionCycle < request->issueCycle 
+        || request->issueCycle < request->arrivalCycle )
+        return;
+
+    ncycle_t latency = request->completionCycle - request->arrivalCycle;
+
+    totalLatency[type].Record( latency );
+    queueLatency[type].Record( request->issueCycle - request->arrivalCycle );
+    arrayLatency[type].Record( request->completionCycle - request->issueCycle );
+    channelLatency[type][channel].Record( latency );
+    bankLatency[type][(channel * p->RANKS + rank) * p->BANKS + bank].Record( latency );
+}
+
+/* Percentiles of every channel or bank that saw requests, keyed by location. */
+std::string NVMain::LocationPercentiles( std::vector<LatencyHistogram>& histograms, bool banks )
+{
+    std::stringstream dict;
+    bool first = true;
+
+    dict << "{";
+    for( size_t i = 0; i < histograms.size( ); i++ )
+    {
+        if( histograms[i].GetCount( ) == 0 )
+            continue;
+
+        if( !first )
+            dict << ", ";
+        first = false;
+
+        if( banks )
+        {
+            dict << "'ch" << i / (p->RANKS * p->BANKS) 
+                 << ".rk" << (i / p->BANKS) % p->RANKS
+                 << ".bk" << i % p->BANKS << "': ";
+        }
+        else
+        {
+            dict << "'ch" << i << "': ";
+        }
+
+        dict << histograms[i].PercentileDict( latencyPercentiles );
+    }
+    dict << "}";
+
+    return dict.str( );
+}
+
+bool NVMain::ChannelIdle( ncounter_t channel )
+{
+    /* Refreshes are issued from the controller cycle, so never skip it. */
+    return ( !p->UseRefresh 
+             && outstandingRequests[channel] == 0
+             && channelIdleCycles[channel] >= idleSettleCycles );
+}
+
+/*
+ *  True when every channel is idle and nothing is waiting to be issued, so
+ *  the memory system can be fast-forwarded.
+ */
+bool NVMain::IsIdle( )
+{
+    if( !config || !memoryControllers || pendingRequestCount > 0 )
+        return false;
+
+    for( unsigned int i = 0; i < numChannels; i++ )
+    {
+        if( !ChannelIdle( i ) )
+            return false;
+    }
+
+    return true;
+}
+
+/*
+ *  Skips up to cpuCycles CPU cycles (e.g., the gap to the next trace request)
+ *  while the memory system is idle. The event queue jumps ahead, stopping at
+ *  the next scheduled event. Returns the number of CPU cycles skipped, or 0
+ *  if the caller needs to call Cycle( ) instead.
+ */
+ncycle_t NVMain::FastForward( ncycle_t cpuCycles )
+{
+    assert( !p->EventDriven );
+
+    if( !p->IdleFastForward || cpuCycles == 0 || !IsIdle( ) )
+        return 0;
+
+    double ratio = static_cast<double>(p->CLK) / static_cast<double>(p->CPUFreq);
+    double target = syncValue + static_cast<double>(cpuCycles) * ratio;
+    ncycle_t memCycles = static_cast<ncycle_t>( target );
+
+    ncycle_t currentCycle = GetEventQueue( )->GetCurrentCycle( );
+    ncycle_t nextEvent = GetEventQueue( )->GetNextEvent( );
+
+    if( nextEvent <= currentCycle )
+        return 0;
+
+    if( nextEvent - currentCycle < memCycles )
+    {
+        memCycles = nextEvent - currentCycle;
+        cpuCycles = static_cast<ncycle_t>( ceil( 
+                    ( static_cast<double>(memCycles) - syncValue ) / ratio ) );
+        target = syncValue + static_cast<double>(cpuCycles) * ratio;
+        memCycles = static_cast<ncycle_t>( target );
+    }
+
+    syncValue = target - static_cast<double>(memCycles);
+
+    if( memCycles > 0 )
+        GetEventQueue( )->Loop( memCycles );
+
+    fastForwardedCycles += memCycles;
+
+    CheckStreamCycle( );
+    CheckCheckpointSave( );
+
+    return cpuCycles;
 }
 
 void NVMain::RegisterStats( )
@@ -566,18 +1044,54 @@ void NVMain::RegisterStats( )
     AddStat(totalWriteRequests);
     AddStat(successfulPrefetches);
     AddStat(unsuccessfulPrefetches);
+    AddStat(skippedChannelCycles);
+    AddStat(fastForwardedCycles);
+
+    AddStat(averageReadLatency);
+    AddStat(averageWriteLatency);
+    AddStat(readLatencyPercentiles);
+    AddStat(writeLatencyPercentiles);
+    AddStat(readQueueLatencyPercentiles);
+    AddStat(writeQueueLatencyPercentiles);
+    AddStat(readArrayLatencyPercentiles);
+    AddStat(writeArrayLatencyPercentiles);
+    AddStat(channelReadLatencyPercentiles);
+    AddStat(channelWriteLatencyPercentiles);
+    AddStat(bankReadLatencyPercentiles);
+    AddStat(bankWriteLatencyPercentiles);
 }
 
 void NVMain::CalculateStats( )
 {
-    std::cout<<"DRAM read number: "<< num_read_requests << "\t read latency: " <<1.0*sum_read_latency/num_read_requests << std::endl;
-    std::cout<<"DRAM write number: "<< num_write_requests << "\t write latency: " <<1.0*sum_write_latency/num_write_requests << std::endl;
+    if( num_read_requests > 0 )
+        averageReadLatency = static_cast<double>(sum_read_latency) 
+                           / static_cast<double>(num_read_requests);
+    if( num_write_requests > 0 )
+        averageWriteLatency = static_cast<double>(sum_write_latency) 
+                            / static_cast<double>(num_write_requests);
+
+    readLatencyPercentiles = totalLatency[LATENCY_READ].PercentileDict( latencyPercentiles );
+    writeLatencyPercentiles = totalLatency[LATENCY_WRITE].PercentileDict( latencyPercentiles );
+    readQueueLatencyPercentiles = queueLatency[LATENCY_READ].PercentileDict( latencyPercentiles );
+    writeQueueLatencyPercentiles = queueLatency[LATENCY_WRITE].PercentileDict( latencyPercentiles );
+    readArrayLatencyPercentiles = arrayLatency[LATENCY_READ].PercentileDict( latencyPercentiles );
+    writeArrayLatencyPercentiles = arrayLatency[LATENCY_WRITE].PercentileDict( latencyPercentiles );
+    channelReadLatencyPercentiles = LocationPercentiles( channelLatency[LATENCY_READ], false );
+    channelWriteLatencyPercentiles = LocationPercentiles( channelLatency[LATENCY_WRITE], false );
+    bankReadLatencyPercentiles = LocationPercentiles( bankLatency[LATENCY_READ], true );
+    bankWriteLatencyPercentiles = LocationPercentiles( bankLatency[LATENCY_WRITE], true );
+
     for( unsigned int i = 0; i < numChannels; i++ )
         memoryControllers[i]->CalculateStats( );
 }
 
 void NVMain::EnqueuePendingMemoryRequests( NVMainRequest *req )
 {
-    pendingMemoryRequests.push(req);
+    ncounter_t channel, rank, bank;
+
+    Locate( req, &channel, &rank, &bank );
+
+    pendingMemoryRequests[channel].push( req );
+    pendingRequestCount++;
 }
 
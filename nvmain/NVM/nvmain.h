@@ -41,8 +41,13 @@
 #include "src/NVMObject.h"
 #include "src/Prefetcher.h"
 #include "include/NVMainRequest.h"
+#include "include/LatencyHistogram.h"
+#include "src/DebugLog.h"
 #include "traceWriter/GenericTraceWriter.h"
+#include <list>
+#include <map>
 #include <queue>
+#include <unordered_map>
 
 namespace NVM {
 
@@ -53,6 +58,8 @@ class Interconnect;
 class AddressTranslator;
 class SimInterface;
 class NVMainRequest;
+class StatsStream;
+class Checkpointable;
 
 class NVMain : public NVMObject
 {
@@ -83,6 +90,12 @@ class NVMain : public NVMObject
 
     void Cycle( ncycle_t steps );
 
+    bool IsIdle( );
+    ncycle_t FastForward( ncycle_t cpuCycles );
+
+    bool SaveCheckpoint( std::string file );
+    bool RestoreCheckpoint( std::string file );
+
     void EnqueuePendingMemoryRequests( NVMainRequest *request );
 
   private:
@@ -100,14 +113,87 @@ class NVMain : public NVMObject
     unsigned int numChannels;
     double syncValue;
 
+    /*
+     *  Requests accepted by each channel and not yet completed. Channels with
+     *  nothing outstanding are not cycled once they have been idle for
+     *  idleSettleCycles (time for the controller to power down its ranks).
+     */
+    ncounter_t *outstandingRequests;
+    ncycle_t *channelIdleCycles;
+    ncycle_t idleSettleCycles;
+    ncounter_t skippedChannelCycles;
+    ncounter_t fastForwardedCycles;
+
+    /*
+     *  Latency histograms for reads and writes, split into queueing (arrival
+     *  to issue) and array (issue to completion) time, plus the total per
+     *  channel and per bank. Banks are indexed by channel, rank, then bank.
+     */
+    enum { LATENCY_READ = 0, LATENCY_WRITE, LATENCY_TYPES };
+    std::vector<double> latencyPercentiles;
+    LatencyHistogram totalLatency[LATENCY_TYPES];
+    LatencyHistogram queueLatency[LATENCY_TYPES];
+    LatencyHistogram arrayLatency[LATENCY_TYPES];
+    std::vector<LatencyHistogram> channelLatency[LATENCY_TYPES];
+    std::vector<LatencyHistogram> bankLatency[LATENCY_TYPES];
+
+    double averageReadLatency;
+    double averageWriteLatency;
+    std::string readLatencyPercentiles;
+    std::string writeLatencyPercentiles;
+    std::string readQueueLatencyPercentiles;
+    std::string writeQueueLatencyPercentiles;
+    std::string readArrayLatencyPercentiles;
+    std::string writeArrayLatencyPercentiles;
+    std::string channelReadLatencyPercentiles;
+    std::string channelWriteLatencyPercentiles;
+    std::string bankReadLatencyPercentiles;
+    std::string bankWriteLatencyPercentiles;
+
+    /* Stats snapshots streamed every statsStreamCycles cycles or statsStreamRequests requests. */
+    StatsStream *statsStream;
+    ncycle_t statsStreamCycles;
+    ncounter_t statsStreamRequests;
+    ncycle_t nextStreamCycle;
+    ncounter_t completedRequests;
+
+    /* Checkpoint written at the first drained cycle after checkpointSaveCycle. */
+    std::string checkpointSaveFile;
+    ncycle_t checkpointSaveCycle;
+
     Prefetcher *prefetcher;
-    std::list<NVMainRequest *> prefetchBuffer;
-    std::queue<NVMainRequest *> pendingMemoryRequests;
+
+    /*
+     *  Prefetched requests are kept in FIFO order for eviction and hashed by
+     *  physical address so demand requests can check for a hit in O(1).
+     */
+    typedef std::list<NVMainRequest *> PrefetchBuffer;
+    typedef std::unordered_map<uint64_t, PrefetchBuffer::iterator> PrefetchIndex;
+    PrefetchBuffer prefetchBuffer;
+    PrefetchIndex prefetchIndex;
+
+    /* Requests waiting for space in their channel, e.g. DRAM cache misses. */
+    std::vector< std::queue<NVMainRequest *> > pendingMemoryRequests;
+    ncounter_t pendingRequestCount;
+
+    DebugLog debugLog;
 
     std::ofstream pretraceOutput;
     GenericTraceWriter *preTracer;
 
     void PrintPreTrace( NVMainRequest *request );
+    void Locate( NVMainRequest *request, ncounter_t *channel, 
+                 ncounter_t *rank, ncounter_t *bank );
+    void RecordLatency( NVMainRequest *request, ncounter_t channel, 
+                        ncounter_t rank, ncounter_t bank );
+    std::string LocationPercentiles( std::vector<LatencyHistogram>& histograms, bool banks );
+    void IssuePendingRequests( ncounter_t channel );
+    void StreamStats( );
+    void CheckStreamCycle( );
+    void CheckCheckpointSave( );
+    std::string ConfigFilePath( std::string file );
+    void FindCheckpointables( NVMObject *object, std::map<std::string, Checkpointable *>& objects );
+    bool ChannelIdle( ncounter_t channel );
     void GeneratePrefetches( NVMainRequest *request, std::vector<NVMAddress>& prefetchList );
 };
 
@@ -0,0 +1,159 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "include/LatencyHistogram.h"
+
+#include <cassert>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+
+using namespace NVM;
+
+LatencyHistogram::LatencyHistogram( unsigned int subBucketBits )
+{
+    assert( subBucketBits >= 1 && subBucketBits < 32 );
+
+    subBits = subBucketBits;
+    subCount = 1ULL << subBits;
+    count = 0;
+    maxValue = 0;
+
+    /* Exact buckets, then half a sub-bucket range for every larger shift. */
+    buckets.resize( subCount + (64 - subBits) * (subCount / 2), 0 );
+}
+
+uint64_t LatencyHistogram::BucketIndex( uint64_t value )
+{
+    if( value < subCount )
+        return value;
+
+    unsigned int msb = 63 - __builtin_clzll( value );
+    unsigned int shift = msb - subBits + 1;
+
+    return subCount + (shift - 1) * (subCount / 2) + ((value >> shift) - subCount / 2);
+}
+
+/* Largest value counted in a bucket, so percentiles never understate. */
+uint64_t LatencyHistogram::BucketValue( uint64_t index )
+{
+    if( index < subCount )
+        return index;
+
+    uint64_t shift = (index - subCount) / (subCount / 2) + 1;
+    uint64_t top = (index - subCount) % (subCount / 2) + subCount / 2;
+
+    return ((top + 1) << shift) - 1;
+}
+
+void LatencyHistogram::Record( uint64_t value )
+{
+    buckets[BucketIndex( value )]++;
+    count++;
+
+    if( value > maxValue )
+        maxValue = value;
+}
+
+void LatencyHistogram::Reset( )
+{
+    buckets.assign( buckets.size( ), 0 );
+    count = 0;
+    maxValue = 0;
+}
+
+uint64_t LatencyHistogram::GetCount( )
+{
+    return count;
+}
+
+uint64_t LatencyHistogram::GetMax( )
+{
+    return maxValue;
+}
+
+uint64_t LatencyHistogram::Percentile( double percentile )
+{
+    if( count == 0 )
+        return 0;
+
+    uint64_t rank = static_cast<uint64_t>( ceil( percentile / 100.0 * static_cast<double>(count) ) );
+    uint64_t seen = 0;
+
+    if( rank == 0 )
+        rank = 1;
+
+    for( uint64_t i = 0; i < buckets.size( ); i++ )
+    {
+        seen += buckets[i];
+
+        if( seen >= rank )
+        {
+            uint64_t value = BucketValue( i );
+
+            return (value < maxValue) ? value : maxValue;
+        }
+    }
+
+    return maxValue;
+}
+
+/* Formats the percentiles as a python dict, e.g. {'p50': 12, 'p99.9': 480} */
+std::string LatencyHistogram::PercentileDict( const std::vector<double>& percentiles )
+{
+    std::stringstream dict;
+
+    dict << "{";
+    for( size_t i = 0; i < percentiles.size( ); i++ )
+    {
+        if( i != 0 )
+            dict << ", ";
+
+        dict << "'p" << percentiles[i] << "': " << Percentile( percentiles[i] );
+    }
+    dict << "}";
+
+    return dict.str( );
+}
+
+/* Reads a comma separated list such as "50,99,99.9". */
+void LatencyHistogram::ParsePercentiles( std::string list, std::vector<double>& percentiles )
+{
+    std::stringstream ss( list );
+    std::string item;
+
+    percentiles.clear( );
+    while( std::getline( ss, item, ',' ) )
+    {
+        double percentile = atof( item.c_str( ) );
+
+        if( percentile > 0.0 && percentile <= 100.0 )
+            percentiles.push_back( percentile );
+    }
+}
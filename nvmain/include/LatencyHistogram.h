@@ -0,0 +1,74 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef __NVMAIN_LATENCYHISTOGRAM_H__
+#define __NVMAIN_LATENCYHISTOGRAM_H__
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace NVM {
+
+/*
+ *  Log-linear (HDR-style) histogram of latencies in cycles. Values below
+ *  2^subBucketBits are counted exactly; larger values fall into one of
+ *  2^(subBucketBits-1) buckets per power of two, so the relative error is
+ *  at most 2^-(subBucketBits-1). Recording is O(1).
+ */
+class LatencyHistogram
+{
+  public:
+    LatencyHistogram( unsigned int subBucketBits = 5 );
+
+    void Record( uint64_t value );
+    void Reset( );
+
+    uint64_t GetCount( );
+    uint64_t GetMax( );
+    uint64_t Percentile( double percentile );
+
+    std::string PercentileDict( const std::vector<double>& percentiles );
+
+    static void ParsePercentiles( std::string list, std::vector<double>& percentiles );
+
+  private:
+    unsigned int subBits;
+    uint64_t subCount;
+    uint64_t count;
+    uint64_t maxValue;
+    std::vector<uint64_t> buckets;
+
+    uint64_t BucketIndex( uint64_t value );
+    uint64_t BucketValue( uint64_t index );
+};
+
+};
+
+#endif
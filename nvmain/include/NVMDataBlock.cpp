@@ -49,6 +49,9 @@ NVMDataBlock::NVMDataBlock( )
     comSize = 0;
     isCompressed = false;
     half = false;
+    dictionary = 0;
+    codecLatency = 0;
+    transferSize = 0;
 }
 
 NVMDataBlock::~NVMDataBlock( )
@@ -137,6 +140,9 @@ NVMDataBlock& NVMDataBlock::operator=( const NVMDataBlock& m )
     //EDFPC
     comSize = m.comSize;
     isCompressed = m.isCompressed;
+    dictionary = m.dictionary;
+    codecLatency = m.codecLatency;
+    transferSize = m.transferSize;
 
     return *this;
 }
@@ -208,4 +214,37 @@ void NVMDataBlock::SetHalfFlag( bool flag )
 bool NVMDataBlock::IsHalf( )
 {
     return half;
-}
\ No newline at end of file
+}
+
+/* DFPC dictionary the compressed line was encoded with. */
+void NVMDataBlock::SetDictionary( uint64_t id )
+{
+    dictionary = id;
+}
+
+uint64_t NVMDataBlock::GetDictionary( )
+{
+    return dictionary;
+}
+
+/* Exposed (de)compression latency the memory pays for this block. */
+void NVMDataBlock::SetCodecLatency( uint64_t cycles )
+{
+    codecLatency = cycles;
+}
+
+uint64_t NVMDataBlock::GetCodecLatency( )
+{
+    return codecLatency;
+}
+
+/* Bytes that cross the bus for this block; 0 means the whole line. */
+void NVMDataBlock::SetTransferSize( uint64_t bytes )
+{
+    transferSize = bytes;
+}
+
+uint64_t NVMDataBlock::GetTransferSize( )
+{
+    return transferSize;
+}
@@ -70,6 +70,12 @@ class NVMDataBlock
     bool IsCompressed( );
     void SetHalfFlag( bool flag );
     bool IsHalf( );
+    void SetDictionary( uint64_t id );
+    uint64_t GetDictionary( );
+    void SetCodecLatency( uint64_t cycles );
+    uint64_t GetCodecLatency( );
+    void SetTransferSize( uint64_t bytes );
+    uint64_t GetTransferSize( );
   
   private:
     bool isValid;
@@ -79,6 +85,9 @@ class NVMDataBlock
     uint64_t comSize;
     bool half;
     bool isCompressed;
+    uint64_t dictionary;
+    uint64_t codecLatency;
+    uint64_t transferSize;
 
     NVMDataBlock( const NVMDataBlock& ) { }
 };
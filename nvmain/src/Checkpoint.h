@@ -0,0 +1,181 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef __NVMAIN_CHECKPOINT_H__
+#define __NVMAIN_CHECKPOINT_H__
+
+#include <istream>
+#include <ostream>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace NVM {
+
+/*
+ *  Objects whose learned or long-lived state (e.g., compression
+ *  dictionaries, flip bits) can be saved and reloaded, so a run can start
+ *  from a warmed-up simulator. NVMain writes one record per object of its
+ *  hierarchy, keyed by stat name; see NVMain::SaveCheckpoint.
+ */
+class Checkpointable
+{
+  public:
+    virtual ~Checkpointable( ) { }
+
+    virtual void SaveCheckpoint( std::ostream& out ) = 0;
+    virtual bool RestoreCheckpoint( std::istream& in ) = 0;
+};
+
+/*
+ *  Binary helpers for checkpoint records. Plain values and structs are
+ *  copied byte for byte, so they must not hold pointers; strings, vectors
+ *  and hash maps are written with their element count first. Containers
+ *  are read aside and only replace the target once fully read.
+ */
+template<typename T> void CheckpointWrite( std::ostream& out, const T& value );
+template<typename T> bool CheckpointRead( std::istream& in, T& value );
+void CheckpointWrite( std::ostream& out, const std::string& value );
+bool CheckpointRead( std::istream& in, std::string& value );
+template<typename T> void CheckpointWrite( std::ostream& out, const std::vector<T>& value );
+template<typename T> bool CheckpointRead( std::istream& in, std::vector<T>& value );
+template<typename K, typename V> void CheckpointWrite( std::ostream& out, const std::unordered_map<K, V>& value );
+template<typename K, typename V> bool CheckpointRead( std::istream& in, std::unordered_map<K, V>& value );
+
+template<typename T> 
+void CheckpointWrite( std::ostream& out, const T& value )
+{
+    out.write( reinterpret_cast<const char *>( &value ), sizeof( T ) );
+}
+
+template<typename T> 
+bool CheckpointRead( std::istream& in, T& value )
+{
+    in.read( reinterpret_cast<char *>( &value ), sizeof( T ) );
+
+    return in.good( );
+}
+
+inline void CheckpointWrite( std::ostream& out, const std::string& value )
+{
+    CheckpointWrite( out, static_cast<uint64_t>( value.size( ) ) );
+    out.write( value.data( ), value.size( ) );
+}
+
+inline bool CheckpointRead( std::istream& in, std::string& value )
+{
+    uint64_t size;
+    std::string read;
+
+    if( !CheckpointRead( in, size ) )
+        return false;
+
+    read.resize( size );
+    if( size > 0 )
+        in.read( &read[0], size );
+
+    if( !in.good( ) )
+        return false;
+
+    value.swap( read );
+
+    return true;
+}
+
+template<typename T> 
+void CheckpointWrite( std::ostream& out, const std::vector<T>& value )
+{
+    CheckpointWrite( out, static_cast<uint64_t>( value.size( ) ) );
+    for( size_t i = 0; i < value.size( ); i++ )
+        CheckpointWrite( out, value[i] );
+}
+
+template<typename T> 
+bool CheckpointRead( std::istream& in, std::vector<T>& value )
+{
+    uint64_t size;
+    std::vector<T> read;
+
+    if( !CheckpointRead( in, size ) )
+        return false;
+
+    for( uint64_t i = 0; i < size; i++ )
+    {
+        T element;
+
+        if( !CheckpointRead( in, element ) )
+            return false;
+
+        read.push_back( element );
+    }
+
+    value.swap( read );
+
+    return true;
+}
+
+template<typename K, typename V> 
+void CheckpointWrite( std::ostream& out, const std::unordered_map<K, V>& value )
+{
+    typename std::unordered_map<K, V>::const_iterator it;
+
+    CheckpointWrite( out, static_cast<uint64_t>( value.size( ) ) );
+    for( it = value.begin( ); it != value.end( ); it++ )
+    {
+        CheckpointWrite( out, it->first );
+        CheckpointWrite( out, it->second );
+    }
+}
+
+template<typename K, typename V> 
+bool CheckpointRead( std::istream& in, std::unordered_map<K, V>& value )
+{
+    uint64_t size;
+    std::unordered_map<K, V> read;
+
+    if( !CheckpointRead( in, size ) )
+        return false;
+
+    for( uint64_t i = 0; i < size; i++ )
+    {
+        K key;
+
+        if( !CheckpointRead( in, key ) || !CheckpointRead( in, read[key] ) )
+            return false;
+    }
+
+    value.swap( read );
+
+    return true;
+}
+
+};
+
+#endif
@@ -488,7 +488,6 @@ void Config::SetDebugLog( )
             std::cerr << "NVMain: Could not open debug log file: " << debugLogFilename << std::endl;
             exit(1);
         }
-        std::cout << &debugLogFile << std::endl;
         std::cout << "Printing debug information to '" << debugLogFilename << "'" << std::endl;
         useDebugLog = true;
     }
@@ -0,0 +1,80 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "src/DebugLog.h"
+
+#include <cassert>
+
+using namespace NVM;
+
+DebugLog::DebugLog( )
+{
+    stream = NULL;
+    lines = 0;
+    limit = 0;
+}
+
+void DebugLog::SetConfig( Config *conf, Params *params, std::string debugClass )
+{
+    name = debugClass;
+    limit = params->DebugLogLimit;
+
+    if( params->debugOn && params->debugClasses.count( debugClass ) > 0 )
+        stream = conf->GetDebugLog( );
+    else
+        stream = NULL;
+}
+
+/* True if the next message should be written; call before each message. */
+bool DebugLog::Enabled( )
+{
+    if( stream == NULL )
+        return false;
+
+    if( limit != 0 && lines >= limit )
+    {
+        if( lines == limit )
+            *stream << name << ": debug output limit of " << limit 
+                    << " lines reached, further messages are dropped." << std::endl;
+
+        lines = limit + 1;
+        return false;
+    }
+
+    lines++;
+
+    return true;
+}
+
+std::ostream& DebugLog::Log( )
+{
+    assert( stream != NULL );
+
+    return *stream;
+}
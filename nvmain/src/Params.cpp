@@ -127,6 +127,8 @@ Params::Params( )
     OffChipLatency = 10;
 
     PeriodicStatsInterval = 0;
+    IdleFastForward = false;
+    LatencyPercentiles = "50,90,99,99.9";
 
     ROWS = 65536;
     COLS = 32;
@@ -184,6 +186,7 @@ Params::Params( )
     WPVariance = 1;
     UniformWrites = false; // Disable MLC by default
     WriteAllBits = false;
+    CompressedBursts = false;
 
     Ereset = 0.054331;
     Eset = 0.101581;
@@ -219,6 +222,7 @@ Params::Params( )
 
     WritePausing = false;
     PauseThreshold = 0.4;
+    PauseRemainingThreshold = tCWD + tBURST;
     MaxCancellations = 4;
     pauseMode = PauseMode_Normal;
 
@@ -226,6 +230,7 @@ Params::Params( )
 
     debugOn = false;
     debugClasses.clear();
+    DebugLogLimit = 1000;
 }
 
 Params::~Params( )
@@ -341,6 +346,8 @@ void Params::SetParams( Config *c )
     c->GetValueUL( "OffChipLatency", OffChipLatency );
 
     c->GetValueUL( "PeriodicStatsInterval", PeriodicStatsInterval );
+    c->GetBool( "IdleFastForward", IdleFastForward );
+    c->GetString( "LatencyPercentiles", LatencyPercentiles );
 
     c->GetValueUL( "ROWS", ROWS );
     c->GetValueUL( "COLS", COLS );
@@ -407,6 +414,7 @@ void Params::SetParams( Config *c )
     c->GetValueUL( "WPVariance",  WPVariance );
     c->GetBool( "UniformWrites", UniformWrites );
     c->GetBool( "WriteAllBits", WriteAllBits );
+    c->GetBool( "CompressedBursts", CompressedBursts );
 
     c->GetEnergy( "Ereset", Ereset );
     c->GetEnergy( "Eset", Eset );
@@ -429,13 +437,13 @@ void Params::SetParams( Config *c )
 	c->GetValueUL( "nWP111", nWP111 );
     
     c->GetEnergy( "Ewr000", Ewr000 );
-    c->GetEnergy( "Ewr001", Ewr000 );
-    c->GetEnergy( "Ewr010", Ewr000 );
-    c->GetEnergy( "Ewr011", Ewr000 );
-    c->GetEnergy( "Ewr100", Ewr000 );
-    c->GetEnergy( "Ewr101", Ewr000 );
-    c->GetEnergy( "Ewr110", Ewr000 );
-    c->GetEnergy( "Ewr111", Ewr000 );
+    c->GetEnergy( "Ewr001", Ewr001 );
+    c->GetEnergy( "Ewr010", Ewr010 );
+    c->GetEnergy( "Ewr011", Ewr011 );
+    c->GetEnergy( "Ewr100", Ewr100 );
+    c->GetEnergy( "Ewr101", Ewr101 );
+    c->GetEnergy( "Ewr110", Ewr110 );
+    c->GetEnergy( "Ewr111", Ewr111 );
     
     c->GetValueUL( "WPMaxVariance", WPMaxVariance );
 
@@ -455,9 +463,12 @@ void Params::SetParams( Config *c )
             debugClasses.insert( debugClass );
         }
     }
+    c->GetValueUL( "DebugLogLimit", DebugLogLimit );
 
     c->GetBool( "WritePausing", WritePausing );
     c->GetEnergy( "PauseThreshold", PauseThreshold );
+    PauseRemainingThreshold = tCWD + tBURST;
+    ConvertTiming( c, "PauseRemainingThreshold", PauseRemainingThreshold );
     c->GetValueUL( "MaxCancellations", MaxCancellations );
     if( c->KeyExists( "PauseMode" ) )
     {
@@ -467,9 +478,28 @@ void Params::SetParams( Config *c )
             pauseMode = PauseMode_IIWC;
         else if( c->GetString( "PauseMode" ) == "Optimal" )
             pauseMode = PauseMode_Optimal;
+        else if( c->GetString( "PauseMode" ) == "Remaining" )
+            pauseMode = PauseMode_Remaining;
         //else
             //std::cout << "Unknown PauseMode: " << c->GetString( "PauseMode" )
             //          << ". Defaulting to Normal" << std::endl;
     }
 }
 
+/*
+ *  With CompressedBursts, a compressed line only occupies the bus for as many
+ *  beats as its compressed bytes need. Lines without a transfer size use the
+ *  full tBURST.
+ */
+ncycle_t Params::BurstCycles( uint64_t bytes )
+{
+    uint64_t bytesPerCycle = BusWidth * RATE / 8;
+    ncycle_t cycles;
+
+    if( !CompressedBursts || bytes == 0 || bytesPerCycle == 0 )
+        return tBURST;
+
+    cycles = static_cast<ncycle_t>( (bytes + bytesPerCycle - 1) / bytesPerCycle );
+
+    return MIN( MAX( cycles, 1 ), tBURST );
+}
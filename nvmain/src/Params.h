@@ -53,7 +53,8 @@ enum ProgramMode {
 enum PauseMode {
     PauseMode_Normal,   ///< Normal pause mode: Wait until write pulse before read
     PauseMode_IIWC,     ///< Intra-Iteration Write Cancellation: allow cancel during write pulse
-    PauseMode_Optimal   ///< Optimal: Same as IIWC, but consider iteration complete
+    PauseMode_Optimal,  ///< Optimal: Same as IIWC, but consider iteration complete
+    PauseMode_Remaining ///< Remaining: Decide from the remaining cell write time
 };
 
 class Params
@@ -64,6 +65,9 @@ class Params
 
     void SetParams( Config *c );
 
+    /* Bus cycles needed to transfer a line of the given size (0 for a full line). */
+    ncycle_t BurstCycles( uint64_t bytes );
+
     bool EventDriven;
 
     ncounter_t BPC;
@@ -128,6 +132,8 @@ class Params
     ncounter_t OffChipLatency;
 
     ncounter_t PeriodicStatsInterval;
+    bool IdleFastForward; // Skip controller cycles while channels are idle
+    std::string LatencyPercentiles; // Comma separated percentiles to report
 
     ncounter_t ROWS;
     ncounter_t COLS;
@@ -185,6 +191,7 @@ class Params
     ncounter_t WPVariance;
     bool UniformWrites;
     bool WriteAllBits; // Set false to calculate write energy on a per-bit basis
+    bool CompressedBursts; // Transfer compressed lines in fewer bus cycles
 
     /* SLC energy */
     double Ereset; 
@@ -226,9 +233,11 @@ class Params
     /* List of debug classes. */
     bool debugOn;
     std::set<std::string> debugClasses;
+    ncounter_t DebugLogLimit; // Lines printed per object, 0 for no limit
 
     bool WritePausing;
     double PauseThreshold;
+    ncycle_t PauseRemainingThreshold; // Remaining write time reads wait out
     ncounter_t MaxCancellations;
     PauseMode pauseMode;
 
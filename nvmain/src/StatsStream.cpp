@@ -0,0 +1,264 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#include "src/StatsStream.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+
+using namespace NVM;
+
+StatsStream::StatsStream( )
+{
+    format = STREAM_JSON;
+    closing = false;
+}
+
+StatsStream::~StatsStream( )
+{
+    Close( );
+}
+
+bool StatsStream::Open( std::string file, std::string streamFormat )
+{
+    output.open( file.c_str( ), std::ofstream::out | std::ofstream::trunc );
+
+    if( !output.is_open( ) )
+    {
+        std::cerr << "StatsStream: Could not open " << file << std::endl;
+        return false;
+    }
+
+    /* Keep large counters exact rather than in exponent notation. */
+    output.precision( 15 );
+
+    format = ( streamFormat == "CSV" || streamFormat == "csv" ) ? STREAM_CSV : STREAM_JSON;
+    closing = false;
+    writer = std::thread( &StatsStream::Run, this );
+
+    return true;
+}
+
+void StatsStream::Push( ncycle_t cycle, ncounter_t requests, const std::string& stats )
+{
+    Snapshot snapshot;
+
+    snapshot.cycle = cycle;
+    snapshot.requests = requests;
+    snapshot.stats = stats;
+
+    {
+        std::lock_guard<std::mutex> guard( queueLock );
+        pending.push_back( snapshot );
+    }
+
+    queueReady.notify_one( );
+}
+
+/* Writes out any queued snapshots and stops the writer thread. */
+void StatsStream::Close( )
+{
+    if( !writer.joinable( ) )
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard( queueLock );
+        closing = true;
+    }
+
+    queueReady.notify_one( );
+    writer.join( );
+    output.close( );
+}
+
+void StatsStream::Run( )
+{
+    std::unique_lock<std::mutex> guard( queueLock );
+
+    while( true )
+    {
+        queueReady.wait( guard, [this] { return closing || !pending.empty( ); } );
+
+        if( pending.empty( ) )
+            break;
+
+        Snapshot snapshot = pending.front( );
+        pending.pop_front( );
+
+        /* Let the simulator keep pushing while this one is written. */
+        guard.unlock( );
+        Write( snapshot );
+        guard.lock( );
+    }
+
+    output.flush( );
+}
+
+bool StatsStream::ParseNumber( const std::string& value, double *number )
+{
+    const char *start = value.c_str( );
+    char *end;
+
+    *number = strtod( start, &end );
+
+    return ( end != start && std::isfinite( *number ) );
+}
+
+void StatsStream::Write( const Snapshot& snapshot )
+{
+    std::vector<std::pair<std::string, std::string> > stats;
+    std::istringstream lines( snapshot.stats );
+    std::string line;
+
+    /* PrintAll writes one "name value" pair per line. */
+    while( std::getline( lines, line ) )
+    {
+        size_t split = line.find( ' ' );
+
+        if( split == std::string::npos || split == 0 )
+            continue;
+
+        size_t start = line.find_first_not_of( ' ', split );
+
+        if( start == std::string::npos )
+            continue;
+
+        std::string name = line.substr( 0, split );
+        std::string value = line.substr( start );
+
+        /* Drop the periodic interval prefix, e.g. "i3." */
+        size_t dot = name.find( '.' );
+        if( name[0] == 'i' && dot != std::string::npos && dot > 1 
+            && name.find_first_not_of( "0123456789", 1 ) == dot )
+        {
+            name = name.substr( dot + 1 );
+        }
+
+        stats.push_back( std::make_pair( name, value ) );
+    }
+
+    if( format == STREAM_CSV )
+        WriteCSV( snapshot, stats );
+    else
+        WriteJSON( snapshot, stats );
+
+    output.flush( );
+}
+
+/*
+ *  One object per snapshot with the current value of every stat and, for
+ *  numeric stats, the change since the previous snapshot.
+ */
+void StatsStream::WriteJSON( const Snapshot& snapshot, 
+                             std::vector<std::pair<std::string, std::string> >& stats )
+{
+    std::stringstream values, deltas;
+    bool firstDelta = true;
+
+    values.precision( output.precision( ) );
+    deltas.precision( output.precision( ) );
+
+    for( size_t i = 0; i < stats.size( ); i++ )
+    {
+        double number;
+
+        if( i != 0 )
+            values << ", ";
+
+        if( ParseNumber( stats[i].second, &number ) )
+        {
+            values << "\"" << stats[i].first << "\": " << number;
+
+            if( !firstDelta )
+                deltas << ", ";
+            firstDelta = false;
+
+            deltas << "\"" << stats[i].first << "\": " << number - lastValues[stats[i].first];
+            lastValues[stats[i].first] = number;
+        }
+        else
+        {
+            std::string escaped;
+
+            for( size_t c = 0; c < stats[i].second.size( ); c++ )
+            {
+                if( stats[i].second[c] == '"' || stats[i].second[c] == '\\' )
+                    escaped += '\\';
+                escaped += stats[i].second[c];
+            }
+
+            values << "\"" << stats[i].first << "\": \"" << escaped << "\"";
+        }
+    }
+
+    output << "{\"cycle\": " << snapshot.cycle << ", \"requests\": " << snapshot.requests
+           << ", \"values\": {" << values.str( ) << "}, \"deltas\": {" << deltas.str( ) 
+           << "}}" << std::endl;
+}
+
+/*
+ *  One row of deltas per snapshot. The columns are the numeric stats of the
+ *  first snapshot; non-numeric stats (e.g., histograms) are left out.
+ */
+void StatsStream::WriteCSV( const Snapshot& snapshot, 
+                            std::vector<std::pair<std::string, std::string> >& stats )
+{
+    std::map<std::string, double> current;
+
+    for( size_t i = 0; i < stats.size( ); i++ )
+    {
+        double number;
+
+        if( ParseNumber( stats[i].second, &number ) )
+            current[stats[i].first] = number;
+    }
+
+    if( columns.empty( ) )
+    {
+        output << "cycle,requests";
+        for( std::map<std::string, double>::iterator it = current.begin( ); it != current.end( ); it++ )
+        {
+            columns.push_back( it->first );
+            output << "," << it->first;
+        }
+        output << std::endl;
+    }
+
+    output << snapshot.cycle << "," << snapshot.requests;
+    for( size_t i = 0; i < columns.size( ); i++ )
+    {
+        double number = current[columns[i]];
+
+        output << "," << number - lastValues[columns[i]];
+        lastValues[columns[i]] = number;
+    }
+    output << std::endl;
+}
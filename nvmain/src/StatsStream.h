@@ -0,0 +1,97 @@
+/*******************************************************************************
+* Copyright (c) 2012-2014, The Microsystems Design Labratory (MDL)
+* Department of Computer Science and Engineering, The Pennsylvania State University
+* All rights reserved.
+* 
+* This source code is part of NVMain - A cycle accurate timing, bit accurate
+* energy simulator for both volatile (e.g., DRAM) and non-volatile memory
+* (e.g., PCRAM). The source code is free and you can redistribute and/or
+* modify it by providing that the following conditions are met:
+* 
+*  1) Redistributions of source code must retain the above copyright notice,
+*     this list of conditions and the following disclaimer.
+* 
+*  2) Redistributions in binary form must reproduce the above copyright notice,
+*     this list of conditions and the following disclaimer in the documentation
+*     and/or other materials provided with the distribution.
+* 
+* THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+* ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+* WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+* DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE LIABLE
+* FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+* DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR
+* SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER
+* CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+* OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+* OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*******************************************************************************/
+
+#ifndef __NVMAIN_STATSSTREAM_H__
+#define __NVMAIN_STATSSTREAM_H__
+
+#include "include/NVMTypes.h"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace NVM {
+
+/*
+ *  Writes periodic stats snapshots to a file as JSON lines or CSV. The
+ *  simulator only hands over the text printed by Stats::PrintAll; parsing,
+ *  computing the deltas from the previous snapshot and writing the file
+ *  happen on a background thread. Producing that text (CalculateStats and
+ *  PrintAll) still stalls the simulator, since the stats are live counters.
+ */
+class StatsStream
+{
+  public:
+    StatsStream( );
+    ~StatsStream( );
+
+    bool Open( std::string file, std::string format );
+    void Push( ncycle_t cycle, ncounter_t requests, const std::string& stats );
+    void Close( );
+
+  private:
+    struct Snapshot
+    {
+        ncycle_t cycle;
+        ncounter_t requests;
+        std::string stats;
+    };
+
+    enum { STREAM_JSON, STREAM_CSV };
+
+    std::ofstream output;
+    int format;
+
+    std::thread writer;
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::deque<Snapshot> pending;
+    bool closing;
+
+    /* Only touched by the writer thread. */
+    std::map<std::string, double> lastValues;
+    std::vector<std::string> columns;
+
+    void Run( );
+    void Write( const Snapshot& snapshot );
+    void WriteJSON( const Snapshot& snapshot, 
+                    std::vector<std::pair<std::string, std::string> >& stats );
+    void WriteCSV( const Snapshot& snapshot, 
+                   std::vector<std::pair<std::string, std::string> >& stats );
+    bool ParseNumber( const std::string& value, double *number );
+};
+
+};
+
+#endif
@@ -45,6 +45,7 @@
 #include <cassert>
 #include <iostream>
 #include <limits>
+#include <sstream>
 
 #define WriteCellData WriteCellData2
 
@@ -128,6 +129,7 @@ SubArray::SubArray( )
 
     endrModel = NULL;
     dataEncoder = NULL;
+    hardErrors = 0;
 
     subArrayId = -1;
 
@@ -146,6 +148,8 @@ void SubArray::SetConfig( Config *c, bool createChildren )
     params->SetParams( c );
     SetParams( params );
 
+    debugLog.SetConfig( c, p, "SubArray" );
+
     MATHeight = p->MATHeight;
     /* customize MAT size */
     if( conf->KeyExists( "MATWidth" ) )
@@ -241,6 +245,7 @@ void SubArray::RegisterStats( )
     {
         AddStat(worstCaseEndurance);
         AddStat(averageEndurance);
+        AddStat(hardErrors);
     }
 
     AddStat(actWaits);
@@ -353,6 +358,7 @@ bool SubArray::Activate( NVMainRequest *request )
 bool SubArray::Read( NVMainRequest *request )
 {
     uint64_t readRow;
+    ncycle_t burst = BurstCycles( request );
 
     request->address.GetTranslatedAddress( &readRow, NULL, NULL, NULL, NULL, NULL );
 
@@ -380,15 +386,16 @@ bool SubArray::Read( NVMainRequest *request )
         return false;
     }
 
-    /* Any additional latency for data encoding. */
+    /* Any additional latency for data encoding and decompression. */
     ncycles_t decLat = (dataEncoder ? dataEncoder->Read( request ) : 0);
+    decLat += request->data.GetCodecLatency( );
 
     /* Update timing constraints */
     if( request->type == READ_PRECHARGE )
     {
         nextActivate = MAX( nextActivate, 
                             GetEventQueue()->GetCurrentCycle()
-                                + MAX( p->tBURST, p->tCCD ) * (request->burstCount - 1)
+                                + MAX( burst, p->tCCD ) * (request->burstCount - 1)
                                 + p->tAL + p->tRTP + p->tRP + decLat );
 
         nextPrecharge = MAX( nextPrecharge, nextActivate );
@@ -402,30 +409,30 @@ bool SubArray::Read( NVMainRequest *request )
         /* insert the event to issue the implicit precharge */ 
         GetEventQueue( )->InsertEvent( EventResponse, this, preReq, 
                         GetEventQueue()->GetCurrentCycle() + p->tAL + p->tRTP + decLat
-                        + MAX( p->tBURST, p->tCCD ) * (request->burstCount - 1) );
+                        + MAX( burst, p->tCCD ) * (request->burstCount - 1) );
     }
     else
     {
         nextPrecharge = MAX( nextPrecharge, 
                              GetEventQueue()->GetCurrentCycle() 
-                                 + MAX( p->tBURST, p->tCCD ) * (request->burstCount - 1)
-                                 + p->tAL + p->tBURST + p->tRTP - p->tCCD + decLat );
+                                 + MAX( burst, p->tCCD ) * (request->burstCount - 1)
+                                 + p->tAL + burst + p->tRTP - p->tCCD + decLat );
 
         nextRead = MAX( nextRead, 
                         GetEventQueue()->GetCurrentCycle() 
-                            + MAX( p->tBURST, p->tCCD ) * request->burstCount );
+                            + MAX( burst, p->tCCD ) * request->burstCount );
 
         nextWrite = MAX( nextWrite, 
                          GetEventQueue()->GetCurrentCycle() 
-                             + MAX( p->tBURST, p->tCCD ) * (request->burstCount  - 1)
-                             + p->tCAS + p->tBURST + p->tRTRS - p->tCWD + decLat );
+                             + MAX( burst, p->tCCD ) * (request->burstCount  - 1)
+                             + p->tCAS + burst + p->tRTRS - p->tCWD + decLat );
     }
 
     /* Read->Powerdown is typical the same for READ and READ_PRECHARGE. */
     nextPowerDown = MAX( nextPowerDown,
                          GetEventQueue()->GetCurrentCycle()
-                            + MAX( p->tBURST, p->tCCD ) * (request->burstCount  - 1)
-                            + p->tCAS + p->tAL + p->tBURST + 1 + decLat );
+                            + MAX( burst, p->tCCD ) * (request->burstCount  - 1)
+                            + p->tCAS + p->tAL + burst + 1 + decLat );
 
     /*
      *  Data is placed on the bus starting from tCAS and is complete after tBURST.
@@ -444,23 +451,23 @@ bool SubArray::Read( NVMainRequest *request )
 
     /* Notify owner of read completion as well */
     GetEventQueue( )->InsertEvent( EventResponse, this, request, 
-            GetEventQueue()->GetCurrentCycle() + p->tCAS + p->tBURST + decLat );
+            GetEventQueue()->GetCurrentCycle() + p->tCAS + burst + decLat );
 
 
     /* Calculate energy */
     if( p->EnergyModel == "current" )
     {
         /* DRAM Model */
-        subArrayEnergy += ( ( p->EIDD4R - p->EIDD3N ) * (double)(p->tBURST) ) / (double)(p->BANKS);
+        subArrayEnergy += ( ( p->EIDD4R - p->EIDD3N ) * (double)(burst) ) / (double)(p->BANKS);
 
-        burstEnergy += ( ( p->EIDD4R - p->EIDD3N ) * (double)(p->tBURST) ) / (double)(p->BANKS);
+        burstEnergy += ( ( p->EIDD4R - p->EIDD3N ) * (double)(burst) ) / (double)(p->BANKS);
     }
     else
     {
         /* Flat Energy Model */
         subArrayEnergy += p->Eopenrd;
 
-        burstEnergy += p->Eopenrd;
+        burstEnergy += p->Eopenrd * (double)burst / (double)p->tBURST;
     }
 
     /*
@@ -489,7 +496,7 @@ bool SubArray::Read( NVMainRequest *request )
     }
 
     reads++;
-    dataCycles += p->tBURST;
+    dataCycles += burst;
     
     return true;
 }
@@ -502,6 +509,7 @@ bool SubArray::Write( NVMainRequest *request )
     uint64_t writeRow;
     ncycle_t writeTimer;
     ncycle_t encLat = 0, endrLat = 0;
+    ncycle_t burst = BurstCycles( request );
     //ncounter_t numUnchangedBits = 0;
 
     request->address.GetTranslatedAddress( &writeRow, NULL, NULL, NULL, NULL, NULL );
@@ -530,6 +538,7 @@ bool SubArray::Write( NVMainRequest *request )
     if( writeMode == WRITE_THROUGH )
     {
         encLat = (dataEncoder ? dataEncoder->Write( request ) : 0);
+        encLat += request->data.GetCodecLatency( );
         endrLat = UpdateEndurance( request );
 
         /* Count the number of bits modified. */
@@ -611,8 +620,8 @@ bool SubArray::Write( NVMainRequest *request )
     {
         nextActivate = MAX( nextActivate, 
                             GetEventQueue()->GetCurrentCycle()
-                            + MAX( p->tBURST, p->tCCD ) * (request->burstCount - 1)
-                            + p->tAL + p->tCWD + p->tBURST 
+                            + MAX( burst, p->tCCD ) * (request->burstCount - 1)
+                            + p->tAL + p->tCWD + burst 
                             + writeTimer + p->tWR + p->tRP );
 
         nextPrecharge = MAX( nextPrecharge, nextActivate );
@@ -627,24 +636,24 @@ bool SubArray::Write( NVMainRequest *request )
         /* insert the event to issue the implicit precharge */ 
         GetEventQueue( )->InsertEvent( EventResponse, this, preReq, 
             GetEventQueue()->GetCurrentCycle() 
-            + MAX( p->tBURST, p->tCCD ) * (request->burstCount - 1)
-            + p->tAL + p->tCWD + p->tBURST + writeTimer + p->tWR );
+            + MAX( burst, p->tCCD ) * (request->burstCount - 1)
+            + p->tAL + p->tCWD + burst + writeTimer + p->tWR );
     }
     else
     {
         nextPrecharge = MAX( nextPrecharge, 
                              GetEventQueue()->GetCurrentCycle() 
-                             + MAX( p->tBURST, p->tCCD ) * (request->burstCount - 1)
-                             + p->tAL + p->tCWD + p->tBURST + writeTimer + p->tWR );
+                             + MAX( burst, p->tCCD ) * (request->burstCount - 1)
+                             + p->tAL + p->tCWD + burst + writeTimer + p->tWR );
 
         nextRead = MAX( nextRead, 
                         GetEventQueue()->GetCurrentCycle() 
-                        + MAX( p->tBURST, p->tCCD ) * (request->burstCount - 1)
-                        + p->tCWD + p->tBURST + p->tWTR + writeTimer );
+                        + MAX( burst, p->tCCD ) * (request->burstCount - 1)
+                        + p->tCWD + burst + p->tWTR + writeTimer );
 
         nextWrite = MAX( nextWrite, 
                          GetEventQueue()->GetCurrentCycle() 
-                         + MAX( p->tBURST, p->tCCD ) * request->burstCount + writeTimer );
+                         + MAX( burst, p->tCCD ) * request->burstCount + writeTimer );
     }
 
     nextPowerDown = MAX( nextPowerDown, nextPrecharge );
@@ -656,7 +665,7 @@ bool SubArray::Write( NVMainRequest *request )
     writeStart = GetEventQueue()->GetCurrentCycle();
     writeEnd = GetEventQueue()->GetCurrentCycle() + writeTimer;
     writeEventTime = GetEventQueue()->GetCurrentCycle() + p->tCWD 
-                     + MAX( p->tBURST, p->tCCD ) * request->burstCount + writeTimer;
+                     + MAX( burst, p->tCCD ) * request->burstCount + writeTimer;
 
     //std::cout << GetEventQueue()->GetCurrentCycle() << " write start 0x" << std::hex
     //          << request->address.GetPhysicalAddress( ) << std::dec << " done at "
@@ -699,9 +708,9 @@ bool SubArray::Write( NVMainRequest *request )
     if( p->EnergyModel == "current" )
     {
         /* DRAM Model. */
-        subArrayEnergy += ( ( p->EIDD4W - p->EIDD3N ) * (double)(p->tBURST) ) / (double)(p->BANKS);
+        subArrayEnergy += ( ( p->EIDD4W - p->EIDD3N ) * (double)(burst) ) / (double)(p->BANKS);
 
-        burstEnergy += ( ( p->EIDD4W - p->EIDD3N ) * (double)(p->tBURST) ) / (double)(p->BANKS);
+        burstEnergy += ( ( p->EIDD4W - p->EIDD3N ) * (double)(burst) ) / (double)(p->BANKS);
     }
     else
     {
@@ -798,13 +807,13 @@ bool SubArray::Write( NVMainRequest *request )
         
         subArrayEnergy += energy;
         
-        burstEnergy += p->Ewr;
+        burstEnergy += p->Ewr * (double)burst / (double)p->tBURST;
     }
 
     writeCycle = true;
 
     writes++;
-    dataCycles += p->tBURST;
+    dataCycles += burst;
     
     return true;
 }
@@ -933,6 +942,7 @@ void SubArray::CheckWritePausing( )
         /* Optimal write progress; no issues pausing at any time. */
         ncycle_t writeProgress = writeEnd - GetEventQueue()->GetCurrentCycle();
         ncycle_t writeTimer = writeEnd - writeStart;
+        ncycle_t nextIterationStart = writeStart;
 
         /* 
          *  Realistically, we need to cancel the current iteration and go back to
@@ -940,7 +950,6 @@ void SubArray::CheckWritePausing( )
          */
         if( p->pauseMode != PauseMode_Optimal )
         {
-            ncycle_t nextIterationStart = writeStart;
             std::set<ncycle_t>::iterator iter;
 
             for( iter = writeIterationStarts.begin(); iter != writeIterationStarts.end(); iter++ )
@@ -967,7 +976,16 @@ void SubArray::CheckWritePausing( )
         //std::cout << "GOT A READ DURING WRITE; PROGRESS IS " << writePercent << std::endl;
 
         /* Pause after 40%, cancel otherwise. */
-        if( writePercent > p->PauseThreshold )
+        bool pauseWrite = ( writePercent > p->PauseThreshold );
+
+        /*
+         *  With the remaining-time policy, pausing keeps every word whose
+         *  pulses already finished. Only cancel when nothing would be kept.
+         */
+        if( p->pauseMode == PauseMode_Remaining )
+            pauseWrite = ( nextIterationStart > writeStart );
+
+        if( pauseWrite )
         {
             /* If optimal is paused on last iteration, it's done. */
             if( writeProgress != writeEnd )
@@ -1016,6 +1034,29 @@ void SubArray::CheckWritePausing( )
     }
 }
 
+/*
+ *  In PauseMode_Remaining, a write whose remaining cell write time is within
+ *  PauseRemainingThreshold is left to finish. Short (compressed) writes then
+ *  never pay the pause and re-issue overhead.
+ */
+bool SubArray::WriteNearlyDone( )
+{
+    if( !p->WritePausing || !isWriting || p->pauseMode != PauseMode_Remaining )
+        return false;
+
+    return ( writeEnd <= GetEventQueue()->GetCurrentCycle() + p->PauseRemainingThreshold );
+}
+
+/*
+ *  This only shortens the subarray's own timing and burst energy; the rank
+ *  and channel data bus spacing (tBURST/tCCD between transfers, rank
+ *  turnaround) still reserves the full tBURST.
+ */
+ncycle_t SubArray::BurstCycles( NVMainRequest *request )
+{
+    return p->BurstCycles( request->data.GetTransferSize( ) );
+}
+
 bool SubArray::BetweenWriteIterations( )
 {
     bool rv = false;
@@ -1249,6 +1290,8 @@ ncycle_t SubArray::WriteCellData2( NVMainRequest *request )
             ncounter_t writeCount110 = CountBitsMLC3( 6, rawData, writeBytes32 );
             ncounter_t writeCount111 = CountBitsMLC3( 7, rawData, writeBytes32 );
             */
+            if( p->pauseMode == PauseMode_Remaining && delay > 0 )
+                writeIterationStarts.insert( GetEventQueue( )->GetCurrentCycle( ) + maxDelay );
             maxDelay += delay;
         }
         
@@ -1295,6 +1338,8 @@ ncycle_t SubArray::WriteCellData2( NVMainRequest *request )
             ncounter_t writeCount110 = CountBitsMLC3( 6, rawData, writeBytes32 );
             ncounter_t writeCount111 = CountBitsMLC3( 7, rawData, writeBytes32 );
             */
+            if( p->pauseMode == PauseMode_Remaining && delay > 0 )
+                writeIterationStarts.insert( GetEventQueue( )->GetCurrentCycle( ) + maxDelay );
             maxDelay += delay;
         }
         
@@ -1335,7 +1380,8 @@ bool SubArray::IsIssuable( NVMainRequest *req, FailReason *reason )
         if( nextActivate > (GetEventQueue()->GetCurrentCycle()) /* if it is too early to open */
             || (p->UsePrecharge && state != SUBARRAY_CLOSED)   /* or, the subarray needs a precharge */
             || (p->WritePausing && isWriting && writeRequest->flags & NVMainRequest::FLAG_FORCED) /* or, write can't be paused. */
-            || (p->WritePausing && isWriting && !(req->flags & NVMainRequest::FLAG_PRIORITY)) ) /* Prevent normal row buffer misses from pausing writes at odd times. */
+            || (p->WritePausing && isWriting && !(req->flags & NVMainRequest::FLAG_PRIORITY)) /* Prevent normal row buffer misses from pausing writes at odd times. */
+            || WriteNearlyDone( ) ) /* or, the write finishes sooner than a pause would. */
         {
             rv = false;
             if( reason ) 
@@ -1357,7 +1403,8 @@ bool SubArray::IsIssuable( NVMainRequest *req, FailReason *reason )
         if( nextRead > (GetEventQueue()->GetCurrentCycle()) /* if it is too early to read */
             || state != SUBARRAY_OPEN  /* or, the subarray is not active */
             || opRow != openRow        /* or, the target row is not the open row */
-            || ( p->WritePausing && isWriting && writeRequest->flags & NVMainRequest::FLAG_FORCED ) ) /* or, write can't be paused. */
+            || ( p->WritePausing && isWriting && writeRequest->flags & NVMainRequest::FLAG_FORCED ) /* or, write can't be paused. */
+            || WriteNearlyDone( ) ) /* or, the write finishes sooner than a pause would. */
         {
             rv = false;
             if( reason ) 
@@ -1616,9 +1663,12 @@ ncycle_t SubArray::UpdateEndurance( NVMainRequest *request )
             {
                 // TODO: Get extra latency from fault model
                 // latency += ...;
-                std::cout << "WARNING: Write to 0x" << std::hex 
-                    << request->address.GetPhysicalAddress( )
-                    << std::dec << " resulted in a hard error! " << std::endl;
+                hardErrors++;
+
+                if( debugLog.Enabled( ) )
+                    debugLog.Log( ) << "WARNING: Write to 0x" << std::hex 
+                        << request->address.GetPhysicalAddress( )
+                        << std::dec << " resulted in a hard error! " << std::endl;
             }
         }
         else
@@ -1673,6 +1723,56 @@ void SubArray::CalculateStats( )
     wpCancelHisto = PyDictHistogram<double, uint64_t>( wpCancelMap );
 }
 
+/*
+ *  The subarray itself keeps no learned state; the data encoder and
+ *  endurance model are saved if they support checkpoints. Each is written
+ *  as a length-prefixed blob so a model without checkpoint support on
+ *  restore is skipped over rather than misreading the stream.
+ */
+void SubArray::SaveCheckpoint( std::ostream& out )
+{
+    Checkpointable *models[2];
+
+    models[0] = dynamic_cast<Checkpointable *>( dataEncoder );
+    models[1] = dynamic_cast<Checkpointable *>( endrModel );
+
+    for( int i = 0; i < 2; i++ )
+    {
+        std::ostringstream blob;
+
+        if( models[i] != NULL )
+            models[i]->SaveCheckpoint( blob );
+
+        CheckpointWrite( out, blob.str( ) );
+    }
+}
+
+bool SubArray::RestoreCheckpoint( std::istream& in )
+{
+    Checkpointable *models[2];
+    bool restored = true;
+
+    models[0] = dynamic_cast<Checkpointable *>( dataEncoder );
+    models[1] = dynamic_cast<Checkpointable *>( endrModel );
+
+    for( int i = 0; i < 2; i++ )
+    {
+        std::string blob;
+
+        if( !CheckpointRead( in, blob ) )
+            return false;
+
+        if( models[i] != NULL && !blob.empty( ) )
+        {
+            std::istringstream blobStream( blob );
+
+            restored = models[i]->RestoreCheckpoint( blobStream ) && restored;
+        }
+    }
+
+    return restored;
+}
+
 bool SubArray::Idle( )
 {
     return ( state == SUBARRAY_CLOSED || state == SUBARRAY_PRECHARGING );
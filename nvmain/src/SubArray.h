@@ -44,6 +44,8 @@
 #include "include/NVMAddress.h"
 #include "include/NVMainRequest.h"
 #include "src/Params.h"
+#include "src/DebugLog.h"
+#include "src/Checkpoint.h"
 
 #include <iostream>
 
@@ -77,7 +79,7 @@ enum WriteMode
     DELAYED_WRITE /* data is stored in a write buffer */
 };
 
-class SubArray : public NVMObject
+class SubArray : public NVMObject, public Checkpointable
 {
   public:
     SubArray( );
@@ -116,6 +118,9 @@ class SubArray : public NVMObject
     void RegisterStats( );
     void CalculateStats( );
 
+    void SaveCheckpoint( std::ostream& out );
+    bool RestoreCheckpoint( std::istream& in );
+
     ncounter_t GetId( );
     std::string GetName( );
 
@@ -183,6 +188,7 @@ class SubArray : public NVMObject
     double refreshEnergy;
 
     uint64_t worstCaseEndurance, averageEndurance;
+    uint64_t hardErrors;
 
     ncounter_t reads, writes, activates, precharges, refreshes;
     ncounter_t idleTimer;
@@ -190,6 +196,7 @@ class SubArray : public NVMObject
     ncounter_t openRow;
 
     DataEncoder *dataEncoder;
+    DebugLog debugLog;
     EnduranceModel *endrModel;
 
     ncounter_t subArrayId;
@@ -206,6 +213,8 @@ class SubArray : public NVMObject
     ncycle_t WriteCellData1( NVMainRequest *request );
     ncycle_t WriteCellData2( NVMainRequest *request );
     void CheckWritePausing( );
+    bool WriteNearlyDone( );
+    ncycle_t BurstCycles( NVMainRequest *request );
 
     ncycle_t UpdateEndurance( NVMainRequest *request );
 